@@ -8,8 +8,11 @@
 #include <string>
 #include <string_view>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 #include <functional>
+#include <mutex>
 #include <memory>
 #include <fstream>
 #include <sstream>
@@ -38,6 +38,15 @@ inline void copy(D* dst, const S* src, size_t n)
     for (size_t i = 0; i < n; ++i)
         *dst++ = *src++;
 }
+
+// float -> double conversion is very common on export (FBX requires double for vertices, normals, etc.).
+// these are vectorized with SSE2 or NEON if available.
+void ConvertFloatToDouble(float64* dst, const float32* src, size_t n);
+inline void copy(float64* dst, const float32* src, size_t n) { ConvertFloatToDouble(dst, src, n); }
+inline void copy(double2* dst, const float2* src, size_t n) { ConvertFloatToDouble((float64*)dst, (const float32*)src, n * 2); }
+inline void copy(double3* dst, const float3* src, size_t n) { ConvertFloatToDouble((float64*)dst, (const float32*)src, n * 3); }
+inline void copy(double4* dst, const float4* src, size_t n) { ConvertFloatToDouble((float64*)dst, (const float32*)src, n * 4); }
+
 template<class D, class S>
 inline void copy(span<D> dst, span<S> src)
 {
@@ -627,7 +627,7 @@ void AnimationCurve::exportFBXObjects()
     n->createChild(sfbxS_Default, (float64)m_default);
     n->createChild(sfbxS_KeyVer, sfbxI_KeyVer);
     n->createChild(sfbxS_KeyTime, times_i64);
-    n->createChild(sfbxS_KeyValueFloat, m_values); // float array
+    n->createChild(sfbxS_KeyValueFloat, make_adaptor<float32>(m_values)); // float array
 
     int attr_flags[] = { 24836 };
     float attr_data[] = { 0, 0, 0, 0 };
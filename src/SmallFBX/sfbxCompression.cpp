@@ -0,0 +1,199 @@
+#include "pch.h"
+#include "sfbxInternal.h"
+
+#ifdef sfbxUseLibdeflate
+    #include <libdeflate.h>
+    #pragma comment(lib, "deflate.lib")
+#else
+    #include <zlib.h>
+    #pragma comment(lib, "zlib.lib")
+#endif
+
+namespace sfbx {
+
+#ifdef sfbxUseLibdeflate
+
+// libdeflate doesn't have a "default" level. 6 is equivalent to zlib's default.
+static const int g_default_level = 6;
+
+struct CodecContext
+{
+    libdeflate_decompressor* decompressor{};
+    libdeflate_compressor* compressor{};
+    int level = -1;
+
+    ~CodecContext()
+    {
+        if (decompressor)
+            libdeflate_free_decompressor(decompressor);
+        if (compressor)
+            libdeflate_free_compressor(compressor);
+    }
+
+    libdeflate_decompressor* getDecompressor()
+    {
+        if (!decompressor)
+            decompressor = libdeflate_alloc_decompressor();
+        return decompressor;
+    }
+
+    libdeflate_compressor* getCompressor(int lv)
+    {
+        if (lv < 0)
+            lv = g_default_level;
+        if (compressor && level != lv) {
+            libdeflate_free_compressor(compressor);
+            compressor = nullptr;
+        }
+        if (!compressor) {
+            compressor = libdeflate_alloc_compressor(lv);
+            level = lv;
+        }
+        return compressor;
+    }
+};
+
+#else // sfbxUseLibdeflate
+
+// z_stream is reused and only reset on each call. initializing it allocates large internal buffers.
+struct CodecContext
+{
+    z_stream inflater{};
+    z_stream deflater{};
+    bool inflater_initialized = false;
+    bool deflater_initialized = false;
+    int level = Z_DEFAULT_COMPRESSION;
+
+    ~CodecContext()
+    {
+        if (inflater_initialized)
+            inflateEnd(&inflater);
+        if (deflater_initialized)
+            deflateEnd(&deflater);
+    }
+
+    z_stream* getInflater()
+    {
+        if (inflater_initialized) {
+            if (inflateReset(&inflater) != Z_OK)
+                return nullptr;
+        }
+        else {
+            if (inflateInit(&inflater) != Z_OK)
+                return nullptr;
+            inflater_initialized = true;
+        }
+        return &inflater;
+    }
+
+    z_stream* getDeflater(int lv)
+    {
+        if (deflater_initialized && level != lv) {
+            deflateEnd(&deflater);
+            deflater_initialized = false;
+        }
+        if (deflater_initialized) {
+            if (deflateReset(&deflater) != Z_OK)
+                return nullptr;
+        }
+        else {
+            // same parameters as compress2() so that the output is identical to it
+            if (deflateInit(&deflater, lv) != Z_OK)
+                return nullptr;
+            deflater_initialized = true;
+            level = lv;
+        }
+        return &deflater;
+    }
+};
+
+#endif // sfbxUseLibdeflate
+
+static CodecContext& GetCodecContext()
+{
+    static thread_local CodecContext s_context;
+    return s_context;
+}
+
+
+size_t DeflateBound(size_t src_size)
+{
+#ifdef sfbxUseLibdeflate
+    return libdeflate_zlib_compress_bound(nullptr, src_size);
+#else
+    return compressBound((uLong)src_size);
+#endif
+}
+
+size_t Deflate(span<char> dst, string_view src, int level)
+{
+#ifdef sfbxUseLibdeflate
+    auto* compressor = GetCodecContext().getCompressor(level);
+    if (!compressor)
+        return 0;
+    return libdeflate_zlib_compress(compressor, src.data(), src.size(), dst.data(), dst.size());
+#else
+    z_stream* zs = GetCodecContext().getDeflater(level);
+    if (!zs)
+        return 0;
+    zs->next_in = (Bytef*)src.data();
+    zs->avail_in = (uInt)src.size();
+    zs->next_out = (Bytef*)dst.data();
+    zs->avail_out = (uInt)dst.size();
+    if (deflate(zs, Z_FINISH) != Z_STREAM_END)
+        return 0;
+    return (size_t)zs->total_out;
+#endif
+}
+
+size_t Deflate(span<char> dst, const std::function<string_view()>& next_chunk, int level)
+{
+#ifdef sfbxUseLibdeflate
+    // libdeflate has no streaming interface. gather the chunks and compress them at once.
+    RawVector<char> src;
+    for (auto chunk = next_chunk(); !chunk.empty(); chunk = next_chunk())
+        src.insert(src.end(), chunk.begin(), chunk.end());
+    return Deflate(dst, make_view(src), level);
+#else
+    z_stream* zs = GetCodecContext().getDeflater(level);
+    if (!zs)
+        return 0;
+    zs->next_out = (Bytef*)dst.data();
+    zs->avail_out = (uInt)dst.size();
+    for (auto chunk = next_chunk(); !chunk.empty(); chunk = next_chunk()) {
+        zs->next_in = (Bytef*)chunk.data();
+        zs->avail_in = (uInt)chunk.size();
+        if (deflate(zs, Z_NO_FLUSH) != Z_OK || zs->avail_in != 0)
+            return 0;
+    }
+    if (deflate(zs, Z_FINISH) != Z_STREAM_END)
+        return 0;
+    return (size_t)zs->total_out;
+#endif
+}
+
+bool Inflate(span<char> dst, string_view src)
+{
+    if (dst.empty())
+        return true;
+#ifdef sfbxUseLibdeflate
+    auto* decompressor = GetCodecContext().getDecompressor();
+    if (!decompressor)
+        return false;
+    size_t size = 0;
+    auto r = libdeflate_zlib_decompress(decompressor, src.data(), src.size(), dst.data(), dst.size(), &size);
+    return r == LIBDEFLATE_SUCCESS && size == dst.size();
+#else
+    z_stream* zs = GetCodecContext().getInflater();
+    if (!zs)
+        return false;
+    zs->next_in = (Bytef*)src.data();
+    zs->avail_in = (uInt)src.size();
+    zs->next_out = (Bytef*)dst.data();
+    zs->avail_out = (uInt)dst.size();
+    int r = inflate(zs, Z_FINISH);
+    return r == Z_STREAM_END && zs->total_out == dst.size();
+#endif
+}
+
+} // namespace sfbx
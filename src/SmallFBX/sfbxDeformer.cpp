@@ -249,7 +249,7 @@ void Cluster::exportFBXObjects()
     n->createChild(sfbxS_Version, sfbxI_ClusterVersion);
     n->createChild(sfbxS_UserData, "", "");
     if (!m_indices.empty())
-        n->createChild(sfbxS_Indexes, m_indices);
+        n->createChild(sfbxS_Indexes, make_adaptor<int>(m_indices));
     if (!m_weights.empty())
         n->createChild(sfbxS_Weights, make_adaptor<float64>(m_weights));
     if (m_transform != float4x4::identity())
@@ -466,7 +466,7 @@ void BindPose::exportFBXObjects()
     n->createChild(sfbxS_NbPoseNodes, (int32)m_pose_data.size());
     for (auto& d : m_pose_data) {
         auto pn = n->createChild(sfbxS_PoseNode);
-        pn->createChild(sfbxS_Node, (int64)d.object);
+        pn->createChild(sfbxS_Node, d.object->getID());
         pn->createChild(sfbxS_Matrix, (double4x4)d.matrix);
     }
 }
@@ -15,6 +15,7 @@ namespace sfbx {
 static const uint8_t g_fbx_header_magic[23]{
     'K', 'a', 'y', 'd', 'a', 'r', 'a', ' ', 'F', 'B', 'X', ' ', 'B', 'i', 'n', 'a', 'r', 'y', ' ', ' ', 0x00, 0x1a, 0x00,
 };
+static const size_t g_fbx_header_size = std::size(g_fbx_header_magic) + 4; // magic + version
 
 // *** these must not be changed. it leads to CRC check failure. ***
 static const char g_fbx_time_id[] = "1970-01-01 10:00:00:000";
@@ -22,20 +23,57 @@ static const uint8_t g_fbx_file_id[16]{ 0x28, 0xb3, 0x2a, 0xeb, 0xb6, 0x24, 0xcc
 static const uint8_t g_fbx_footer_magic1[16]{ 0xfa, 0xbc, 0xab, 0x09, 0xd0, 0xc8, 0xd4, 0x66, 0xb1, 0x76, 0xfb, 0x83, 0x1c, 0xf7, 0x26, 0x7e };
 static const uint8_t g_fbx_footer_magic2[16]{ 0xf8, 0x5a, 0x8c, 0x6a, 0xde, 0xf5, 0xd9, 0x7e, 0xec, 0xe9, 0x0c, 0xe3, 0x75, 0x8f, 0x29, 0x0b };
 
+// compressed arrays of the last writeBinary(). key is the hash of the array.
+// source is the uncompressed array. it is compared with the array before reuse as hashes can collide.
+struct Document::CompressedArrayCache
+{
+    struct Entry
+    {
+        PropertyType type{};
+        uint64_t array_size{};
+        int level{};
+        RawVector<char> source;
+        RawVector<char> data;
+    };
+    std::unordered_map<uint64_t, Entry> arrays;
+    std::mutex mutex;
+};
+
 
 Document::Document()
+    : m_compressed_arrays(std::make_shared<CompressedArrayCache>())
 {
     initialize();
 }
 
-Document::Document(std::istream& input)
+Document::Document(std::istream& input, const LoadOptions& opt)
+    : m_compressed_arrays(std::make_shared<CompressedArrayCache>())
+{
+    read(input, opt);
+}
+
+Document::Document(const std::string& path, const LoadOptions& opt)
+    : m_compressed_arrays(std::make_shared<CompressedArrayCache>())
+{
+    read(path, opt);
+}
+
+Document::Document(const char* path, const LoadOptions& opt)
+    : m_compressed_arrays(std::make_shared<CompressedArrayCache>())
 {
-    read(input);
+    read(path, opt);
 }
 
-Document::Document(const std::string& path)
+Document::Document(span<const char> data, const LoadOptions& opt)
+    : m_compressed_arrays(std::make_shared<CompressedArrayCache>())
 {
-    read(path);
+    read(data, opt);
+}
+
+Document::Document(RawVector<char>&& data, const LoadOptions& opt)
+    : m_compressed_arrays(std::make_shared<CompressedArrayCache>())
+{
+    read(std::move(data), opt);
 }
 
 bool Document::valid() const
@@ -49,33 +87,61 @@ void Document::initialize()
     m_root_model->setID(0);
 }
 
-bool Document::readAscii(std::istream& is)
+// ascii FBX must start with ';'. even FBX SDK doesn't recognize without that.
+static bool IsAscii(string_view data)
 {
-    {
-        std::string line;
-        std::getline(is, line);
+    return !data.empty() && data.front() == ';';
+}
 
-        int major, minor, patch;
-        const char* s = std::strstr(line.c_str(), "FBX");
-        if (!s || sscanf(s, "FBX %d.%d.%d project file", &major, &minor, &patch) != 3) {
-            sfbxPrint("sfbx::Document::read(): not a fbx file\n");
-            return false;
-        }
-        m_version = (FileVersion)(major * 1000 + minor * 100);
+// the first line of ascii FBX. e.g. "; FBX 7.4.0 project file"
+static bool ReadAsciiHeader(const std::string& line, FileVersion& version)
+{
+    int major, minor, patch;
+    const char* s = std::strstr(line.c_str(), "FBX");
+    if (!s || sscanf(s, "FBX %d.%d.%d project file", &major, &minor, &patch) != 3)
+        return false;
+    version = (FileVersion)(major * 1000 + minor * 100);
+    return true;
+}
+
+static bool ReadAsciiHeader(string_view& is, FileVersion& version)
+{
+    return ReadAsciiHeader(std::string(get_line(is)), version);
+}
+
+// magic and version. is points to the first node after this.
+static bool ReadBinaryHeader(string_view& is, FileVersion& version)
+{
+    if (is.size() < g_fbx_header_size || memcmp(is.data(), g_fbx_header_magic, std::size(g_fbx_header_magic)) != 0)
+        return false;
+    skip_n(is, std::size(g_fbx_header_magic));
+    version = (FileVersion)read1<uint32_t>(is);
+    return true;
+}
+
+bool Document::readAscii(string_view is)
+{
+    if (!ReadAsciiHeader(is, m_version)) {
+        sfbxPrint("sfbx::Document::read(): not a fbx file\n");
+        return false;
     }
 
     try {
-        while (!is.eof()) {
-            std::string block = read_brace_block(is);
-            if (block.empty())
-                break;
-
-            string_view block_view = block;
-            auto node = createNode();
-            node->readAscii(block_view);
-            if (node->isNull()) {
-                eraseNode(node);
-                break;
+        // nodes are built directly from the data. no copies of blocks or lines.
+        AsciiTokenizer tk(is);
+        if (m_load_options.parallel) {
+            readAsciiParallel(tk);
+        }
+        else {
+            for (;;) {
+                auto node = createNode();
+                bool read = node->readAscii(tk);
+                if (node->isNull()) {
+                    // skipped (see LoadOptions::skip_nodes) or no more nodes
+                    eraseNode(node);
+                    if (!read)
+                        break;
+                }
             }
         }
         importFBXObjects();
@@ -88,26 +154,80 @@ bool Document::readAscii(std::istream& is)
     return true;
 }
 
-bool Document::readBinary(std::istream& is)
+void Document::readAsciiParallel(AsciiTokenizer& tk)
+{
+    struct Record
+    {
+        string_view data;
+        bool objects;
+        std::vector<NodePtr> nodes; // the node and its descendants
+    };
+
+    // index pre-pass. top-level nodes are skipped without building nodes to find where each of them is.
+    std::vector<Record> records;
+    for (;;) {
+        const char* begin = tk.tell();
+        string_view name;
+        if (!SkipAsciiNode(tk, name))
+            break;
+        if (!isSkippedNode(nullptr, name))
+            records.push_back({ make_view(begin, tk.tell()), name == sfbxS_Objects, {} });
+    }
+
+    // parse top-level nodes other than "Objects" in parallel. each of them has own node storage.
+    // "Objects" is parsed later by Node::readAscii(), which parses the objects in it in parallel.
+    std::vector<Record*> others;
+    for (auto& r : records) {
+        if (!r.objects)
+            others.push_back(&r);
+    }
+    ParallelFor(others.size(), [&](size_t i) {
+        auto& r = *others[i];
+        auto node = std::make_shared<Node>();
+        node->m_document = this;
+        r.nodes.push_back(node);
+        AsciiTokenizer node_tk(r.data);
+        node->readAscii(node_tk, &r.nodes);
+    });
+
+    // merge. the order of nodes is the same as sequential parsing.
+    for (auto& r : records) {
+        if (r.objects) {
+            AsciiTokenizer node_tk(r.data);
+            createNode()->readAscii(node_tk);
+        }
+        else {
+            m_root_nodes.push_back(r.nodes.front().get());
+            addNodes(r.nodes);
+        }
+    }
+}
+
+bool Document::readBinary(string_view is)
 {
-    char magic[std::size(g_fbx_header_magic)];
-    readv(is, magic, std::size(g_fbx_header_magic));
-    if (memcmp(magic, g_fbx_header_magic, std::size(g_fbx_header_magic)) != 0) {
+    if (!ReadBinaryHeader(is, m_version)) {
         sfbxPrint("sfbx::Document::read(): not a fbx file\n");
         return false;
     }
-    m_version = (FileVersion)read1<uint32_t>(is);
 
     try {
-        uint64_t pos = std::size(g_fbx_header_magic) + 4;
+        uint64_t pos = g_fbx_header_size;
         for (;;) {
-            auto node = createNode();
-            pos += node->readBinary(is, pos);
-            if (node->isNull()) {
-                eraseNode(node);
+            string_view tmp = is;
+            BinaryNodeHeader header;
+            ReadBinaryNodeHeader(tmp, (uint32_t)m_version, header);
+            if (header.end_offset == 0) // null record. terminates top-level nodes.
                 break;
+            if (isSkippedNode(nullptr, header.name)) {
+                pos += SkipBinaryNode(is, pos, header);
+                continue;
             }
+
+            auto node = createNode();
+            pos += node->readBinary(is, pos);
         }
+        if (!m_load_options.lazy_decompression)
+            decompressProperties();
         importFBXObjects();
     }
     catch (const std::runtime_error& e) {
@@ -117,11 +237,153 @@ bool Document::readBinary(std::istream& is)
     return true;
 }
 
+bool Document::isSkippedNode(const Node* parent, string_view name) const
+{
+    auto& opt = m_load_options;
+    if (!parent) {
+        return std::find(opt.skip_nodes.begin(), opt.skip_nodes.end(), name) != opt.skip_nodes.end();
+    }
+    else if (!opt.skip_objects.empty() && !parent->getParent() && parent->getName() == sfbxS_Objects) {
+        for (ObjectClass c : opt.skip_objects) {
+            if (GetObjectClassName(c) == name)
+                return true;
+        }
+    }
+    return false;
+}
+
+void Document::decompressProperties()
+{
+    std::vector<const Property*> compressed;
+    for (auto& node : m_nodes) {
+        for (auto& prop : node->getProperties()) {
+            if (prop.isCompressed())
+                compressed.push_back(&prop);
+        }
+    }
+    // each property has its own buffer. no synchronization is needed.
+    ParallelFor(compressed.size(), [&](size_t i) { compressed[i]->decompress(); });
+}
+
+void Document::compressProperties(BinaryWriteContext& ctx, const WriteOptions& wopt) const
+{
+    auto& opt = wopt.compression;
+    auto parallel_for = [&wopt](size_t n, const std::function<void(size_t)>& body) {
+        if (wopt.parallel) {
+            ParallelFor(n, body);
+        }
+        else {
+            for (size_t i = 0; i < n; ++i)
+                body(i);
+        }
+    };
+
+    // classify arrays once. the level depends only on the uncompressed size, so it is the same for arrays that are
+    // still compressed (see LoadOptions::lazy_decompression) and is used as is for the cache below.
+    std::vector<const Property*> arrays;
+    std::vector<int> levels;
+    for (auto& node : m_nodes) {
+        for (auto& prop : node->getProperties()) {
+            int level = prop.getCompressionLevel(opt);
+            if (level != 0) {
+                arrays.push_back(&prop);
+                levels.push_back(level);
+            }
+        }
+    }
+
+    // each array has its own buffer. the results are moved into ctx after all of them are done.
+    std::vector<RawVector<char>> results(arrays.size());
+    auto finish = [&]() {
+        for (size_t i = 0; i < arrays.size(); ++i) {
+            if (!results[i].empty())
+                ctx.compressed[arrays[i]] = std::move(results[i]);
+        }
+    };
+
+    if (!wopt.reuse_compressed_arrays || !m_compressed_arrays) {
+        parallel_for(arrays.size(), [&](size_t i) { arrays[i]->getCompressed(opt, results[i]); });
+        finish();
+        return;
+    }
+
+    std::vector<uint64_t> hashes(arrays.size());
+    parallel_for(arrays.size(), [&](size_t i) { hashes[i] = arrays[i]->getPayloadHash(); });
+
+    // the cache is shared by all writes of this document
+    std::lock_guard<std::mutex> lock(m_compressed_arrays->mutex);
+
+    // the hash only tells the array may be unchanged. compare with the source of the cached one to be sure.
+    std::vector<CompressedArrayCache::Entry*> found(arrays.size());
+    parallel_for(arrays.size(), [&](size_t i) {
+        const Property* prop = arrays[i];
+        auto& arrays = m_compressed_arrays->arrays;
+        auto it = arrays.find(hashes[i]);
+        if (it != arrays.end()) {
+            auto& ca = it->second;
+            if (ca.type == prop->getType() && ca.array_size == prop->getArraySize() && ca.level == levels[i] &&
+                prop->equalsPayload(make_view(ca.source)))
+                found[i] = &ca;
+        }
+    });
+
+    // reuse unchanged arrays and compress the rest
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < arrays.size(); ++i) {
+        if (found[i])
+            results[i] = found[i]->data;
+        else
+            changed.push_back(i);
+    }
+    parallel_for(changed.size(), [&](size_t i) { arrays[changed[i]]->getCompressed(opt, results[changed[i]]); });
+
+    // keep the results for the next write. arrays that no longer exist are dropped.
+    // arrays with the same hash but different contents are not kept. they are compressed on every write.
+    std::unordered_map<uint64_t, CompressedArrayCache::Entry> cache;
+    std::vector<std::pair<const Property*, CompressedArrayCache::Entry*>> added;
+    for (size_t i = 0; i < arrays.size(); ++i) {
+        const Property* prop = arrays[i];
+        if (results[i].empty() || cache.count(hashes[i]))
+            continue;
+        auto& dst = cache[hashes[i]];
+        dst.type = prop->getType();
+        dst.array_size = prop->getArraySize();
+        dst.level = levels[i];
+        dst.data = results[i];
+        if (found[i])
+            dst.source = std::move(found[i]->source);
+        else
+            added.push_back({ prop, &dst });
+    }
+    parallel_for(added.size(), [&](size_t i) { added[i].first->getPayload(added[i].second->source); });
+    m_compressed_arrays->arrays.swap(cache);
+    finish();
+}
+
+// true if obj->importFBXObjects() touches nothing but its own node and members.
+// such objects can be imported concurrently.
+static bool IsSelfContainedImport(Object* obj)
+{
+    switch (obj->getClass()) {
+    case ObjectClass::Geometry:
+        return obj->getSubClass() == ObjectSubClass::Mesh || obj->getSubClass() == ObjectSubClass::Shape;
+    case ObjectClass::Deformer:
+        return obj->getSubClass() == ObjectSubClass::Cluster;
+    case ObjectClass::AnimationCurve:
+        return true;
+    default:
+        return false;
+    }
+}
+
 void Document::importFBXObjects()
 {
     if (Node* objects = findNode(sfbxS_Objects)) {
         initialize();
         for (Node* n : objects->getChildren()) {
+            // just in case. nodes of skipped objects are not read in the first place.
+            if (isSkippedNode(objects, n->getName()))
+                continue;
             if (Object* obj = createObject(GetObjectClass(n), GetObjectSubClass(n))) {
                 obj->setNode(n);
             }
@@ -160,10 +422,24 @@ void Document::importFBXObjects()
         }
     }
 
+    // heavy objects that only read their own node (mesh, cluster, curve, etc.) are imported in parallel first.
+    // the rest may refer other objects or create new ones, so they are imported in order afterwards.
+    size_t num_initial_objects = m_objects.size();
+    bool parallel = m_load_options.parallel;
+    if (parallel) {
+        std::vector<Object*> independent;
+        for (auto& obj : m_objects) {
+            if (IsSelfContainedImport(obj.get()))
+                independent.push_back(obj.get());
+        }
+        ParallelFor(independent.size(), [&](size_t i) { independent[i]->importFBXObjects(); });
+    }
+
     // index based loop because m_objects maybe push_backed in the loop
     for (size_t i = 0; i < m_objects.size(); ++i) {
         auto obj = m_objects[i];
-        obj->importFBXObjects();
+        if (!parallel || i >= num_initial_objects || !IsSelfContainedImport(obj.get()))
+            obj->importFBXObjects();
         if (obj->getParents().empty())
             m_root_objects.push_back(obj.get());
     }
@@ -238,45 +514,117 @@ void GlobalSettings::importFBXObjects(Document *doc)
 }
 
 
-bool Document::read(std::istream& is)
+bool Document::read(std::istream& is, const LoadOptions& opt)
 {
-    unload();
+    // load whole data and parse it in place.
+    RawVector<char> data;
+    if (!ReadAll(is, data)) {
+        unload();
+        return false;
+    }
+    return read(std::move(data), opt);
+}
 
-    char c;
-    is.get(c);
-    is.unget();
+bool Document::read(span<const char> data, const LoadOptions& opt)
+{
+    unload();
+    m_load_options = opt;
 
-    // ascii FBX must start with ';'. even FBX SDK doesn't recognize without that.
-    if (c == ';')
+    auto is = make_view(data.data(), data.size());
+    if (IsAscii(is))
         return readAscii(is);
-    else
-        return readBinary(is);
+
+    bool ret = readBinary(is);
+    // data may be discarded after this. properties must not refer it.
+    for (auto& node : m_nodes) {
+        for (auto& prop : node->getProperties())
+            prop.detach();
+    }
+    return ret;
 }
 
-bool Document::read(const std::string& path)
+bool Document::read(RawVector<char>&& data, const LoadOptions& opt)
 {
     unload();
+    m_load_options = opt;
+
+    m_buffer = std::move(data);
+    auto is = make_view(m_buffer);
+    if (IsAscii(is)) {
+        // nodes of ascii FBX have own copies. the buffer is no longer needed.
+        bool ret = readAscii(is);
+        m_buffer.clear();
+        m_buffer.shrink_to_fit();
+        return ret;
+    }
+    return readBinary(is);
+}
+
+bool Document::read(const char* path, const LoadOptions& opt)
+{
+    return read(std::string(path), opt);
+}
+
+bool Document::read(const std::string& path, const LoadOptions& opt)
+{
+    unload();
+    m_load_options = opt;
+
+    if (opt.memory_mapped) {
+        auto mf = std::make_shared<MemoryMappedFile>();
+        if (mf->open(path.c_str())) {
+            auto data = mf->getData();
+            if (IsAscii(data))
+                return readAscii(data);
+            m_mapped_file = mf;
+            return readBinary(data);
+        }
+        // failed to map. fall back to std::ifstream.
+    }
 
     std::ifstream file;
     file.open(path, std::ios::in | std::ios::binary);
     if (file)
-        return read(file);
+        return read(file, opt);
     return false;
 }
 
 
-bool Document::writeBinary(std::ostream& os) const
+bool Document::writeBinary(std::ostream& os, const WriteOptions& opt) const
 {
+    OutputBuffer buf(os);
+    return writeBinary(buf, opt);
+}
+
+bool Document::writeBinary(const std::string& path, const WriteOptions& opt) const
+{
+    // write to the file directly. no std::ofstream in between.
+    OutputBuffer buf;
+    if (buf.open(path.c_str()))
+        return writeBinary(buf, opt);
+    return false;
+}
+
+bool Document::writeBinary(OutputBuffer& os, const WriteOptions& opt) const
+{
+    // all state of this write is kept in ctx. concurrent writes of the same document don't interfere.
+    BinaryWriteContext ctx;
+    ctx.compression = opt.compression;
+
+    // compression is the heaviest part. do it for all arrays in parallel beforehand.
+    if (opt.parallel || opt.reuse_compressed_arrays)
+        compressProperties(ctx, opt);
+
     writev(os, g_fbx_header_magic);
     writev(os, m_version);
 
     uint64_t pos = std::size(g_fbx_header_magic) + 4;
     for (Node* node : m_root_nodes)
-        pos += node->writeBinary(os, pos);
+        pos += node->writeBinary(os, pos, ctx);
     {
         Node null_node;
         null_node.m_document = const_cast<Document*>(this);
-        pos += null_node.writeBinary(os, pos);
+        pos += null_node.writeBinary(os, pos, ctx);
     }
 
     // footer
@@ -286,37 +634,42 @@ bool Document::writeBinary(std::ostream& os) const
 
     // add padding to 16 byte align
     uint64_t pad = 16 - (pos % 16);
-    for (uint64_t i = 0; i < pad; ++i)
-        writev(os, (int8)0);
+    os.fill(0, pad);
 
     writev(os, (int32)0);
     writev(os, m_version);
 
     // 120 byte space
-    for (uint64_t i = 0; i < 120; ++i)
-        writev(os, (int8)0);
+    os.fill(0, 120);
 
     writev(os, g_fbx_footer_magic2);
 
-    return true;
+    return os.flush();
 }
 
-bool Document::writeBinary(const std::string& path) const
+bool Document::writeAscii(std::ostream& os) const
 {
-    std::ofstream file;
-    file.open(path, std::ios::out | std::ios::binary);
-    if (file)
-        return writeBinary(file);
+    OutputBuffer buf(os);
+    return writeAscii(buf);
+}
+
+bool Document::writeAscii(const std::string& path) const
+{
+    // write to the file directly. no std::ofstream in between.
+    OutputBuffer buf;
+    if (buf.open(path.c_str()))
+        return writeAscii(buf);
     return false;
 }
 
-bool Document::writeAscii(std::ostream& os) const
+bool Document::writeAscii(OutputBuffer& os) const
 {
+    std::string text;
     char version[128];
     sprintf(version, "; FBX %d.%d.0 project file\n", (int)m_version / 1000 % 10, (int)m_version / 100 % 10);
 
-    os << version;
-    os << "; ----------------------------------------------------\n\n";
+    text += version;
+    text += "; ----------------------------------------------------\n\n";
 
     for (auto node : getRootNodes()) {
         // these nodes seem required only in binary format.
@@ -324,19 +677,11 @@ bool Document::writeAscii(std::ostream& os) const
             node->getName() == sfbxS_CreationTime ||
             node->getName() == sfbxS_Creator)
             continue;
-        node->writeAscii(os);
+        node->writeAscii(os, text, 0);
     }
+    os.write(text.data(), text.size());
 
-    return true;
-}
-
-bool Document::writeAscii(const std::string& path) const
-{
-    std::ofstream file;
-    file.open(path, std::ios::out | std::ios::binary);
-    if (file)
-        return writeAscii(file);
-    return false;
+    return os.flush();
 }
 
 
@@ -353,6 +698,30 @@ void Document::unload()
     m_anim_stacks.clear();
     m_root_model = {};
     m_current_take = {};
+
+    m_mapped_file = {};
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+
+    clearCompressedArrays();
+}
+
+void Document::clearCompressedArrays()
+{
+    if (!m_compressed_arrays)
+        return;
+    std::lock_guard<std::mutex> lock(m_compressed_arrays->mutex);
+    m_compressed_arrays->arrays = {};
+}
+
+const LoadOptions& Document::getLoadOptions() const
+{
+    return m_load_options;
+}
+
+const ExportOptions& Document::getExportOptions() const
+{
+    return m_export_options;
 }
 
 FileVersion Document::getFileVersion() const
@@ -382,6 +751,16 @@ Node* Document::createChildNode(string_view name)
     return n;
 }
 
+void Document::reserveNodes(size_t n)
+{
+    m_nodes.reserve(m_nodes.size() + n);
+}
+
+void Document::addNodes(span<NodePtr> nodes)
+{
+    m_nodes.insert(m_nodes.end(), nodes.begin(), nodes.end());
+}
+
 void Document::eraseNode(Node* n)
 {
     erase_if(m_nodes, [n](const NodePtr& p) { return p.get() == n; });
@@ -579,13 +958,61 @@ bool Document::mergeAnimations(const std::string& path)
 }
 
 
-void Document::exportFBXNodes()
+// hash of the classes and names of obj and its ancestors. used as the ID of obj with ExportOptions::deterministic.
+static uint64_t HashObjectPath(const Object* obj)
+{
+    uint64_t ret = 0;
+    // depth limit just in case of circular parenting
+    for (int depth = 0; obj && depth < 256; obj = obj->getParent(), ++depth) {
+        int classes[]{ (int)obj->getClass(), (int)obj->getSubClass() };
+        string_view name = obj->getFullName();
+        ret = Hash64(classes, sizeof(classes), ret);
+        ret = Hash64(name.data(), name.size(), ret);
+    }
+    return ret;
+}
+
+void Document::exportFBXNodes(const ExportOptions& opt)
 {
+    m_export_options = opt;
     m_nodes.clear();
     m_root_nodes.clear();
 
-    std::time_t t = std::time(nullptr);
-    std::tm* now = std::localtime(&t);
+    std::time_t t = opt.deterministic ? 0 : std::time(nullptr);
+    std::tm* now = opt.deterministic ? std::gmtime(&t) : std::localtime(&t);
+    int64 doc_id = opt.deterministic ? (int64)(Hash64(sfbxS_Documents, std::strlen(sfbxS_Documents)) >> 1) : (int64)this;
+
+    // IDs of objects created in memory are their addresses (see Object::Object()).
+    // with ExportOptions::deterministic, replace them with hashes that don't change between runs.
+    // the replacement is only for the export. the original IDs are restored at the end.
+    std::unordered_set<int64> used_ids;
+    std::vector<std::pair<Object*, int64>> original_ids;
+    auto assign_stable_id = [&used_ids, &original_ids](Object* obj) {
+        if (obj->getID() != (int64)obj)
+            return;
+        uint64_t hash = HashObjectPath(obj);
+        for (;;) {
+            // positive and non-zero. resolve collisions by rehashing.
+            int64 id = (int64)(hash >> 1);
+            if (id != 0 && used_ids.insert(id).second) {
+                original_ids.push_back({ obj, obj->getID() });
+                obj->setID(id);
+                break;
+            }
+            hash = Hash64(&hash, sizeof(hash), hash);
+        }
+    };
+    if (opt.deterministic) {
+        used_ids.insert(doc_id);
+        for (auto& obj : m_objects) {
+            if (obj->getID() != (int64)obj.get())
+                used_ids.insert(obj->getID());
+        }
+        // do all objects beforehand because some objects refer others' IDs on export (e.g. BindPose)
+        for (auto& obj : m_objects)
+            assign_stable_id(obj.get());
+    }
+
     std::string take_name{ m_current_take ? m_current_take->getName() : "" };
 
     auto header_extension = createNode(sfbxS_FBXHeaderExtension);
@@ -678,7 +1105,7 @@ void Document::exportFBXNodes()
         documents->createChild(sfbxS_Count, (int32)1);
         auto doc = documents->createChild(sfbxS_Document);
         {
-            doc->addProperties((int64)this, "My Scene", "Scene");
+            doc->addProperties(doc_id, "My Scene", "Scene");
 
             auto prop = doc->createChild(sfbxS_Properties70);
             prop->createChild(sfbxS_P, sfbxS_SourceObject, sfbxS_object, "", "");
@@ -696,8 +1123,12 @@ void Document::exportFBXNodes()
     createNode(sfbxS_Connections);
 
     // index based loop because m_objects maybe push_backed in the loop
-    for (size_t i = 0; i < m_objects.size(); ++i)
+    for (size_t i = 0; i < m_objects.size(); ++i) {
+        // objects created in the loop (e.g. NodeAttribute) need stable IDs too
+        if (opt.deterministic)
+            assign_stable_id(m_objects[i].get());
         m_objects[i]->exportFBXObjects();
+    }
     for (size_t i = 0; i < m_objects.size(); ++i)
         m_objects[i]->exportFBXConnections();
 
@@ -742,6 +1173,10 @@ void Document::exportFBXNodes()
         if (rstart != 0.0f || rstop != 0.0f)
             take->createChild(sfbxS_ReferenceTime, ToTicks(rstart), ToTicks(rstop));
     }
+
+    for (auto& [obj, id] : original_ids)
+        obj->setID(id);
+    m_export_options = {};
 }
 
 
@@ -755,4 +1190,398 @@ template<class T> T* Object::createChild(string_view name)
 sfbxEachObjectType(Body)
 #undef Body
 
+
+
+// returns the size of the record. visitor is not notified if it is a null record.
+static uint64_t VisitBinaryNode(string_view& is, uint64_t start_offset, uint32_t version, NodeVisitor& visitor)
+{
+    BinaryNodeHeader header;
+    uint64_t ret = ReadBinaryNodeHeader(is, version, header);
+    if (header.end_offset == 0)
+        return ret;
+    if (header.end_offset <= start_offset || header.end_offset - start_offset - ret > is.size())
+        throw std::runtime_error("sfbx::VisitNodes(): invalid end offset");
+
+    if (!visitor.enterNode(header.name)) {
+        is.remove_prefix(header.end_offset - start_offset - ret);
+        return header.end_offset - start_offset;
+    }
+
+    for (uint64_t i = 0; i < header.num_props; i++) {
+        // compressed arrays are kept compressed and visitor decides whether to decompress
+        Property prop;
+        prop.read(is, true);
+        visitor.visitProperty(prop);
+    }
+    ret += header.prop_size;
+
+    while (start_offset + ret < header.end_offset)
+        ret += VisitBinaryNode(is, start_offset + ret, version, visitor);
+    visitor.leaveNode(header.name);
+    return ret;
+}
+
+static bool VisitBinary(string_view is, NodeVisitor& visitor)
+{
+    FileVersion version;
+    if (!ReadBinaryHeader(is, version)) {
+        sfbxPrint("sfbx::VisitNodes(): not a fbx file\n");
+        return false;
+    }
+
+    try {
+        visitor.enterDocument(version);
+        uint64_t pos = g_fbx_header_size;
+        for (;;) {
+            // peek the header to detect the null record that terminates top-level nodes
+            string_view tmp = is;
+            BinaryNodeHeader header;
+            ReadBinaryNodeHeader(tmp, (uint32_t)version, header);
+            if (header.end_offset == 0)
+                break;
+            pos += VisitBinaryNode(is, pos, (uint32_t)version, visitor);
+        }
+        visitor.leaveDocument();
+    }
+    catch (const std::runtime_error& e) {
+        sfbxPrint("sfbx::VisitNodes(): exception %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+static bool VisitAscii(string_view is, NodeVisitor& visitor)
+{
+    FileVersion version;
+    if (!ReadAsciiHeader(is, version)) {
+        sfbxPrint("sfbx::VisitNodes(): not a fbx file\n");
+        return false;
+    }
+
+    try {
+        // same parser as Document::read(). nodes are notified as they are parsed.
+        visitor.enterDocument(version);
+        while (ReadAsciiNode(is, visitor)) {}
+        visitor.leaveDocument();
+    }
+    catch (const std::runtime_error& e) {
+        sfbxPrint("sfbx::VisitNodes(): exception %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+static void ReadExact(std::istream& is, char* dst, size_t size)
+{
+    is.read(dst, size);
+    if ((size_t)is.gcount() != size)
+        throw std::runtime_error("sfbx::VisitNodes(): unexpected end of data");
+}
+
+// stream version of ReadBinaryNodeHeader(). buf receives the header and dst.name refers it.
+static uint64_t ReadBinaryNodeHeader(std::istream& is, uint32_t version, BinaryNodeHeader& dst, std::string& buf)
+{
+    size_t size = version >= sfbxI_FBX2016_FileVersion ? 25 : 13; // 3 size records and the length of the name
+    buf.resize(size);
+    ReadExact(is, buf.data(), size);
+    size_t name_len = (uint8_t)buf[size - 1];
+    buf.resize(size + name_len);
+    ReadExact(is, buf.data() + size, name_len);
+
+    string_view view = buf;
+    return ReadBinaryNodeHeader(view, version, dst);
+}
+
+// stream version of VisitBinaryNode(). only properties of the current node are kept in buf.
+static uint64_t VisitBinaryNode(std::istream& is, uint64_t start_offset, uint64_t header_size, const BinaryNodeHeader& header,
+    uint32_t version, NodeVisitor& visitor, RawVector<char>& buf)
+{
+    uint64_t ret = header_size;
+    if (header.end_offset <= start_offset || header.end_offset - start_offset < ret + header.prop_size)
+        throw std::runtime_error("sfbx::VisitNodes(): invalid end offset");
+
+    if (!visitor.enterNode(header.name)) {
+        uint64_t rest = header.end_offset - start_offset - ret;
+        is.ignore((std::streamsize)rest);
+        if ((uint64_t)is.gcount() != rest)
+            throw std::runtime_error("sfbx::VisitNodes(): unexpected end of data");
+        return header.end_offset - start_offset;
+    }
+
+    buf.resize(header.prop_size);
+    ReadExact(is, buf.data(), buf.size());
+    string_view props = make_view(buf);
+    for (uint64_t i = 0; i < header.num_props; i++) {
+        Property prop;
+        prop.read(props, true);
+        visitor.visitProperty(prop);
+    }
+    ret += header.prop_size;
+
+    while (start_offset + ret < header.end_offset) {
+        BinaryNodeHeader child;
+        std::string name;
+        uint64_t size = ReadBinaryNodeHeader(is, version, child, name);
+        if (child.end_offset == 0)
+            ret += size;
+        else
+            ret += VisitBinaryNode(is, start_offset + ret, size, child, version, visitor, buf);
+    }
+    visitor.leaveNode(header.name);
+    return ret;
+}
+
+bool VisitNodes(std::istream& is, NodeVisitor& visitor)
+{
+    // ascii FBX is tokenized as a whole
+    if (is.peek() == ';') {
+        RawVector<char> buffer;
+        if (!ReadAll(is, buffer))
+            return false;
+        return VisitAscii(make_view(buffer), visitor);
+    }
+
+    // binary FBX is read record by record
+    char head[g_fbx_header_size];
+    is.read(head, sizeof(head));
+    string_view head_view(head, (size_t)is.gcount());
+    FileVersion version;
+    if (!ReadBinaryHeader(head_view, version)) {
+        sfbxPrint("sfbx::VisitNodes(): not a fbx file\n");
+        return false;
+    }
+
+    try {
+        visitor.enterDocument(version);
+        RawVector<char> buf;
+        uint64_t pos = g_fbx_header_size;
+        for (;;) {
+            BinaryNodeHeader header;
+            std::string name;
+            uint64_t size = ReadBinaryNodeHeader(is, (uint32_t)version, header, name);
+            if (header.end_offset == 0)
+                break;
+            pos += VisitBinaryNode(is, pos, size, header, (uint32_t)version, visitor, buf);
+        }
+        visitor.leaveDocument();
+    }
+    catch (const std::runtime_error& e) {
+        sfbxPrint("sfbx::VisitNodes(): exception %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool VisitNodes(const std::string& path, NodeVisitor& visitor)
+{
+    {
+        MemoryMappedFile mf;
+        if (mf.open(path.c_str())) {
+            if (IsAscii(mf.getData()))
+                return VisitAscii(mf.getData(), visitor);
+            return VisitBinary(mf.getData(), visitor);
+        }
+    }
+
+    std::ifstream file;
+    file.open(path, std::ios::in | std::ios::binary);
+    if (file)
+        return VisitNodes(file, visitor);
+    return false;
+}
+
+
+// read the node at is and its descendants and add the sizes of their arrays (after decompression) to array_size.
+// only headers are read. payloads are skipped without being decompressed nor copied. returns the size of the record.
+static uint64_t ProbeBinaryArrays(string_view& is, uint64_t start_offset, uint32_t version, uint64_t& array_size)
+{
+    BinaryNodeHeader header;
+    uint64_t ret = ReadBinaryNodeHeader(is, version, header);
+    if (header.end_offset == 0)
+        return ret;
+    if (header.end_offset <= start_offset || header.end_offset - start_offset - ret > is.size())
+        throw std::runtime_error("sfbx::ProbeFile(): invalid end offset");
+
+    string_view props = readv(is, header.prop_size);
+    for (uint64_t i = 0; i < header.num_props; i++) {
+        auto type = read1<PropertyType>(props);
+        switch (type) {
+        case PropertyType::Bool: skip_n(props, 1); break;
+        case PropertyType::Int16: skip_n(props, 2); break;
+        case PropertyType::Int32:
+        case PropertyType::Float32: skip_n(props, 4); break;
+        case PropertyType::Int64:
+        case PropertyType::Float64: skip_n(props, 8); break;
+        case PropertyType::String:
+        case PropertyType::Blob: readv(props, read1<uint32_t>(props)); break;
+        default:
+        {
+            // array: element count, encoding, payload size and payload
+            uint32_t num_elements = read1<uint32_t>(props);
+            read1<uint32_t>(props);
+            uint32_t payload_size = read1<uint32_t>(props);
+            readv(props, payload_size);
+            array_size += (uint64_t)num_elements * SizeOfElement(type);
+            break;
+        }
+        }
+    }
+    ret += header.prop_size;
+
+    while (start_offset + ret < header.end_offset)
+        ret += ProbeBinaryArrays(is, start_offset + ret, version, array_size);
+    return ret;
+}
+
+FileInfo ProbeFile(const std::string& path)
+{
+    struct Prober : public NodeVisitor
+    {
+        FileInfo info;
+        std::vector<string_view> path; // names of current node and its ancestors
+        FileInfo::ObjectType* object_type{};
+        std::string* take{};
+
+        FileInfo::ObjectType* getObjectType(string_view name)
+        {
+            for (auto& ot : info.object_types)
+                if (ot.name == name)
+                    return &ot;
+            info.object_types.push_back({ std::string(name) });
+            return &info.object_types.back();
+        }
+
+        static int64 toInt(const Property& prop)
+        {
+            switch (prop.getType()) {
+            case PropertyType::Int16: return prop.getValue<int16>();
+            case PropertyType::Int32: return prop.getValue<int32>();
+            case PropertyType::Int64: return prop.getValue<int64>();
+            case PropertyType::Float64: return (int64)prop.getValue<float64>();
+            default: return 0;
+            }
+        }
+
+        void enterDocument(FileVersion v) override
+        {
+            info.version = v;
+        }
+
+        bool enterNode(string_view name) override
+        {
+            size_t depth = path.size();
+            bool ret = false;
+            if (depth == 0) {
+                // "Objects" of binary FBX is read by ProbeBinaryArrays(). it is skipped in ascii FBX. arrays are not counted.
+                ret = name == sfbxS_Definitions || name == sfbxS_Takes;
+            }
+            else if (path[0] == sfbxS_Definitions) {
+                // Definitions / ObjectType / Count
+                ret = (depth == 1 && name == sfbxS_ObjectType) || (depth == 2 && name == sfbxS_Count);
+            }
+            else if (path[0] == sfbxS_Takes) {
+                ret = depth == 1 && name == sfbxS_Take;
+            }
+
+            if (ret)
+                path.push_back(name);
+            return ret;
+        }
+
+        void visitProperty(const Property& prop) override
+        {
+            size_t depth = path.size();
+            if (path[0] == sfbxS_Definitions) {
+                if (depth == 2 && prop.getType() == PropertyType::String)
+                    object_type = getObjectType(prop.getString());
+                else if (depth == 3 && object_type)
+                    object_type->count = toInt(prop);
+            }
+            else if (path[0] == sfbxS_Takes) {
+                if (depth == 2 && prop.getType() == PropertyType::String && !take)
+                    take = &info.takes.emplace_back(prop.getString());
+            }
+        }
+
+        void leaveNode(string_view /*name*/) override
+        {
+            path.pop_back();
+            if (path.size() <= 1) {
+                object_type = nullptr;
+                take = nullptr;
+            }
+        }
+    } prober;
+    auto& info = prober.info;
+
+    // the file is opened once. it is memory-mapped and only the parts to read are touched.
+    MemoryMappedFile mf;
+    RawVector<char> buffer;
+    string_view data;
+    if (mf.open(path.c_str())) {
+        data = mf.getData();
+    }
+    else {
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        if (!file || !ReadAll(file, buffer))
+            return info;
+        data = make_view(buffer);
+    }
+
+    info.ascii = IsAscii(data);
+    if (info.ascii) {
+        if (!VisitAscii(data, prober))
+            info.version = FileVersion::Unknown;
+        return info;
+    }
+
+    string_view is = data;
+    FileVersion version;
+    if (!ReadBinaryHeader(is, version)) {
+        sfbxPrint("sfbx::ProbeFile(): not a fbx file\n");
+        return info;
+    }
+    try {
+        prober.enterDocument(version);
+        uint64_t pos = g_fbx_header_size;
+        for (;;) {
+            // top-level records other than these are skipped by their end offsets
+            string_view tmp = is;
+            BinaryNodeHeader header;
+            ReadBinaryNodeHeader(tmp, (uint32_t)version, header);
+            if (header.end_offset == 0)
+                break;
+
+            if (header.name == sfbxS_Definitions || header.name == sfbxS_Takes) {
+                // small records. visit them as usual.
+                pos += VisitBinaryNode(is, pos, (uint32_t)version, prober);
+            }
+            else if (header.name == sfbxS_Objects) {
+                uint64_t end_offset = header.end_offset;
+                uint64_t size = ReadBinaryNodeHeader(is, (uint32_t)version, header);
+                readv(is, header.prop_size);
+                size += header.prop_size;
+                while (pos + size < end_offset) {
+                    tmp = is;
+                    BinaryNodeHeader object;
+                    ReadBinaryNodeHeader(tmp, (uint32_t)version, object);
+                    uint64_t unused = 0;
+                    uint64_t& array_size = object.end_offset != 0 ? prober.getObjectType(object.name)->array_size : unused;
+                    size += ProbeBinaryArrays(is, pos + size, (uint32_t)version, array_size);
+                }
+                pos += size;
+            }
+            else {
+                pos += SkipBinaryNode(is, pos, header);
+            }
+        }
+        prober.leaveDocument();
+    }
+    catch (const std::runtime_error& e) {
+        sfbxPrint("sfbx::ProbeFile(): exception %s\n", e.what());
+        info.version = FileVersion::Unknown;
+    }
+    return info;
+}
+
 } // namespace sfbx
@@ -53,20 +53,89 @@ struct GlobalSettings
     void importFBXObjects(Document *doc);
 };
 
+struct LoadOptions
+{
+    // map the file into memory instead of reading it via std::ifstream. (relevant only for binary FBX read from a path)
+    // properties refer the mapped memory directly, so the file must not be modified while the Document is alive.
+    bool memory_mapped = false;
+
+    // keep zlib-compressed arrays as they are and inflate on first access. (relevant only for binary FBX)
+    // saves the cost of inflating arrays that are never touched (e.g. KeyAttrFlags, unused layer elements).
+    // array properties are no longer safe to access concurrently even via const methods.
+    bool lazy_decompression = false;
+
+    // top-level nodes to skip (e.g. sfbxS_Takes). skipped nodes are not even parsed in binary FBX.
+    std::vector<std::string> skip_nodes;
+    // classes of objects to skip (e.g. ObjectClass::Geometry to load only skeletons and animations).
+    // their nodes under "Objects" are skipped as well as skip_nodes.
+    std::vector<ObjectClass> skip_objects;
+
+    // use worker threads for heavy tasks such as decompression of arrays and import of meshes and animation curves.
+    // ignored if the library is built without multithreading support (e.g. emscripten without pthreads).
+    bool parallel = true;
+};
+
+struct ExportOptions
+{
+    // array properties refer objects' data (vertices, normals, weights, etc.) instead of holding converted copies.
+    // payloads are generated chunk by chunk when written, so peak memory usage is close to the size of the scene data.
+    // objects must not be modified until the document is written. call exportFBXNodes() again if they are.
+    bool refer_object_data = false;
+
+    // make the output depend only on the scene, so identical scenes give byte-identical files.
+    // IDs of objects created in memory (their addresses by default) are replaced with hashes of the classes and names
+    // of the objects and their parents, and the creation time stamp is fixed. loaded objects keep their IDs.
+    // the hashes are used only in the exported nodes. objects keep their IDs after exportFBXNodes().
+    bool deterministic = false;
+};
+
+struct WriteOptions
+{
+    // compression of array properties in binary FBX. e.g. set compression.store_only for intermediate files.
+    CompressionOptions compression;
+
+    // compress arrays with worker threads.
+    // ignored if the library is built without multithreading support (e.g. emscripten without pthreads).
+    bool parallel = true;
+
+    // keep compressed arrays in the document and reuse them in the next writeBinary() if the arrays are unchanged.
+    // unchanged arrays are detected by hashing and comparing with the kept copy of the array, which is far faster than compression.
+    // useful for saving a document repeatedly. (e.g. an interactive tool)
+    // costs memory of about the size of the arrays both compressed and uncompressed.
+    // Document::clearCompressedArrays() releases it. read() and unload() also do.
+    bool reuse_compressed_arrays = false;
+};
+
+class MemoryMappedFile;
+class OutputBuffer;
+struct BinaryWriteContext;
+
 class Document
 {
 public:
     Document();
-    explicit Document(std::istream& is);
-    explicit Document(const std::string& path);
+    explicit Document(std::istream& is, const LoadOptions& opt = {});
+    explicit Document(const std::string& path, const LoadOptions& opt = {});
+    explicit Document(const char* path, const LoadOptions& opt = {});
+    explicit Document(span<const char> data, const LoadOptions& opt = {});
+    explicit Document(RawVector<char>&& data, const LoadOptions& opt = {});
     bool valid() const;
 
-    bool read(std::istream& is);
-    bool read(const std::string& path);
-    bool writeBinary(std::ostream& os) const;
-    bool writeBinary(const std::string& path) const;
+    bool read(std::istream& is, const LoadOptions& opt = {});
+    bool read(const std::string& path, const LoadOptions& opt = {});
+    bool read(const char* path, const LoadOptions& opt = {});
+    // read from memory. data is no longer needed after this (properties make own copies if needed).
+    bool read(span<const char> data, const LoadOptions& opt = {});
+    // read from memory and take ownership of data. properties refer it directly instead of holding copies.
+    bool read(RawVector<char>&& data, const LoadOptions& opt = {});
+    // the same document can be written on multiple threads at once, unless it still has compressed arrays.
+    // (see LoadOptions::lazy_decompression. writing inflates them)
+    bool writeBinary(std::ostream& os, const WriteOptions& opt = {}) const;
+    bool writeBinary(const std::string& path, const WriteOptions& opt = {}) const;
     bool writeAscii(std::ostream& os) const;
     bool writeAscii(const std::string& path) const;
+    // release the compressed arrays kept by WriteOptions::reuse_compressed_arrays.
+    void clearCompressedArrays();
 
     FileVersion getFileVersion() const;
     void setFileVersion(FileVersion v);
@@ -93,7 +162,7 @@ public:
     bool mergeAnimations(std::istream& input);
     bool mergeAnimations(const std::string& path);
 
-    void exportFBXNodes();
+    void exportFBXNodes(const ExportOptions& opt = {});
 
     // utils
     template<class T>
@@ -109,12 +178,19 @@ public:
     // internal
 
     void unload();
-    bool readAscii(std::istream& is);
-    bool readBinary(std::istream& is);
+    const LoadOptions& getLoadOptions() const;
+    const ExportOptions& getExportOptions() const;
+    bool readAscii(string_view is);
+    bool readBinary(string_view is);
+    // parent is null for top-level nodes. see LoadOptions::skip_nodes and skip_objects.
+    bool isSkippedNode(const Node* parent, string_view name) const;
 
     Node* createNode(string_view name = {});
     Node* createChildNode(string_view name = {});
     void eraseNode(Node* n);
+    // add nodes created outside the document. (e.g. parsed by worker threads)
+    void reserveNodes(size_t n);
+    void addNodes(span<NodePtr> nodes);
     Node* findNode(string_view name) const;
     span<NodePtr> getAllNodes() const;
     span<Node*> getRootNodes() const;
@@ -128,9 +204,26 @@ public:
 
 private:
     void initialize();
+    // parse top-level nodes and objects in parallel. the result is the same as sequential parsing.
+    void readAsciiParallel(AsciiTokenizer& tk);
+    void decompressProperties();
+    void compressProperties(BinaryWriteContext& ctx, const WriteOptions& opt) const;
+    bool writeBinary(OutputBuffer& os, const WriteOptions& opt) const;
+    bool writeAscii(OutputBuffer& os) const;
     void importFBXObjects();
 
     FileVersion m_version = FileVersion::Default;
+    LoadOptions m_load_options;
+    ExportOptions m_export_options; // valid while exportFBXNodes()
+
+    // compressed arrays of the last writeBinary() and its mutex. (see WriteOptions::reuse_compressed_arrays)
+    // held by pointer to keep Document copyable and movable. copies share it.
+    struct CompressedArrayCache;
+    std::shared_ptr<CompressedArrayCache> m_compressed_arrays;
+
+    // source data of binary FBX. properties refer these directly instead of holding copies.
+    std::shared_ptr<MemoryMappedFile> m_mapped_file;
+    RawVector<char> m_buffer;
 
     std::vector<NodePtr> m_nodes;
     std::vector<Node*> m_root_nodes;
@@ -142,6 +235,53 @@ private:
     AnimationStack* m_current_take{};
 };
 
+
+// SAX-style reader. VisitNodes() notifies nodes to the visitor as it parses them, without building a Document.
+// FBX read from a path is memory-mapped. so memory usage doesn't depend on the file size.
+class NodeVisitor
+{
+public:
+    virtual ~NodeVisitor() {}
+    virtual void enterDocument(FileVersion /*version*/) {}
+    virtual void leaveDocument() {}
+
+    // return false to skip the node. its properties and children are not visited and leaveNode() is not called.
+    virtual bool enterNode(string_view /*name*/) { return true; }
+    // prop is valid only during the call. compressed arrays are decompressed on access. (see Property::getArray())
+    virtual void visitProperty(const Property& /*prop*/) {}
+    virtual void leaveNode(string_view /*name*/) {}
+};
+
+// binary FBX is read from the stream record by record. only the properties of the current node are kept in memory.
+// ascii FBX is read into memory as a whole before visiting.
+bool VisitNodes(std::istream& is, NodeVisitor& visitor);
+bool VisitNodes(const std::string& path, NodeVisitor& visitor);
+
+
+// summary of a file that ProbeFile() gathers without building a Document.
+struct FileInfo
+{
+    struct ObjectType
+    {
+        std::string name; // "Model", "Geometry", etc.
+        int64 count = 0; // object count in "Definitions"
+        // total size in bytes of the arrays in the objects of this type (after decompression).
+        // available only for binary FBX.
+        uint64_t array_size = 0;
+    };
+
+    FileVersion version = FileVersion::Unknown; // Unknown if failed to read
+    bool ascii = false;
+    std::vector<ObjectType> object_types;
+    std::vector<std::string> takes;
+};
+
+// reads only what is needed. in binary FBX, top-level records other than "Definitions", "Objects" and "Takes" are skipped
+// by their end offsets, and only the headers of arrays in "Objects" are read. arrays are neither decompressed nor copied.
+// in ascii FBX, "Objects" is skipped without being parsed.
+FileInfo ProbeFile(const std::string& path);
+
+
 template<class... T>
 inline DocumentPtr MakeDocument(T&&... v)
 {
@@ -250,7 +250,7 @@ void GeomMesh::exportFBXObjects()
         add_mapping_and_reference_info(l, layer);
         l->createChild(sfbxS_Normals, make_adaptor<double3>(layer.data));
         if (!layer.indices.empty())
-            l->createChild(sfbxS_NormalsIndex, layer.indices);
+            l->createChild(sfbxS_NormalsIndex, make_adaptor<int>(layer.indices));
     }
 
     // uv layers
@@ -266,7 +266,7 @@ void GeomMesh::exportFBXObjects()
         add_mapping_and_reference_info(l, layer);
         l->createChild(sfbxS_UV, make_adaptor<double2>(layer.data));
         if (!layer.indices.empty())
-            l->createChild(sfbxS_UVIndex, layer.indices);
+            l->createChild(sfbxS_UVIndex, make_adaptor<int>(layer.indices));
     }
 
     // color layers
@@ -282,7 +282,7 @@ void GeomMesh::exportFBXObjects()
         add_mapping_and_reference_info(l, layer);
         l->createChild(sfbxS_Colors, make_adaptor<double4>(layer.data));
         if (!layer.indices.empty())
-            l->createChild(sfbxS_ColorIndex, layer.indices);
+            l->createChild(sfbxS_ColorIndex, make_adaptor<int>(layer.indices));
     }
 
     // material layers
@@ -298,7 +298,7 @@ void GeomMesh::exportFBXObjects()
         //TODO add_mapping_and_reference_info+checkModes?
         l->createChild(sfbxS_MappingInformationType, "ByPolygon");
         l->createChild(sfbxS_ReferenceInformationType, "Direct");
-        l->createChild(sfbxS_Materials, layer.data);
+        l->createChild(sfbxS_Materials, make_adaptor<int>(layer.data));
     }
 
     if (clayers) {
@@ -422,7 +422,7 @@ void Shape::exportFBXObjects()
     Node* n = getNode();
     n->createChild(sfbxS_Version, sfbxI_ShapeVersion);
     if (!m_indices.empty())
-        n->createChild(sfbxS_Indexes, m_indices);
+        n->createChild(sfbxS_Indexes, make_adaptor<int>(m_indices));
     if (!m_delta_points.empty())
         n->createChild(sfbxS_Vertices, make_adaptor<double3>(m_delta_points));
     if (!m_delta_normals.empty())
@@ -8,6 +8,11 @@
 
 #define sfbxEnableLegacyFormatSupport
 
+// emscripten can use threads only if built with pthread support
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+    #define sfbxEnableMultithreading
+#endif
+
 namespace sfbx {
 
 template<class T, sfbxRestrict(std::is_pod_v<T> && !std::is_pointer_v<T>)>
@@ -27,6 +32,145 @@ inline void readv(std::istream& is, std::string& dst, size_t s)
     is.read(dst.data(), s);
 }
 
+// string_view versions consume the view. these throw std::runtime_error if the data is too short.
+template<class T, sfbxRestrict(std::is_pod_v<T> && !std::is_pointer_v<T>)>
+inline T read1(string_view& is)
+{
+    if (is.size() < sizeof(T))
+        throw std::runtime_error("sfbx::read1(): unexpected end of data");
+    T r;
+    memcpy(&r, is.data(), sizeof(T));
+    is.remove_prefix(sizeof(T));
+    return r;
+}
+inline string_view readv(string_view& is, size_t size)
+{
+    if (is.size() < size)
+        throw std::runtime_error("sfbx::readv(): unexpected end of data");
+    auto r = is.substr(0, size);
+    is.remove_prefix(size);
+    return r;
+}
+
+// 64bit non-cryptographic hash (MurmurHash64A). seed can be the hash of the previous part to hash data in pieces.
+uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
+
+// read all remaining data of the stream
+bool ReadAll(std::istream& is, RawVector<char>& dst);
+
+// zlib-format compression of array properties. implemented in sfbxCompression.cpp.
+// the backend is zlib or libdeflate (if sfbxUseLibdeflate is defined), both keep per-thread contexts to avoid initialization costs.
+// level: 0-9, or -1 for the default of the backend.
+size_t DeflateBound(size_t src_size);
+// returns the compressed size. 0 if failed.
+size_t Deflate(span<char> dst, string_view src, int level = -1);
+// streaming version. next_chunk() returns the next part of the source, or empty when it is done.
+// the output is identical to compressing the whole source at once.
+size_t Deflate(span<char> dst, const std::function<string_view()>& next_chunk, int level = -1);
+// dst must be the exact size of the decompressed data.
+bool Inflate(span<char> dst, string_view src);
+
+// header of a node record in binary FBX.
+// end_offset is the absolute position of the end of the record. a null record (all zero) terminates a node list.
+struct BinaryNodeHeader
+{
+    uint64_t end_offset{};
+    uint64_t num_props{};
+    uint64_t prop_size{};
+    string_view name;
+};
+// returns the size of the header. size records are 64bit since FBX 2016 so version is needed.
+uint64_t ReadBinaryNodeHeader(string_view& is, uint32_t version, BinaryNodeHeader& dst);
+// seek is past the record that starts at start_offset. is must point to the beginning of the record. returns the size of the record.
+uint64_t SkipBinaryNode(string_view& is, uint64_t start_offset, const BinaryNodeHeader& header);
+
+// parse a node in ascii FBX and its children, and notify them to visitor. returns false if there is no node to read.
+bool ReadAsciiNode(string_view& is, NodeVisitor& visitor);
+// skip a node in ascii FBX without building it. name receives the name of the node. returns false if there is no node to read.
+bool SkipAsciiNode(AsciiTokenizer& tk, string_view& name);
+
+// state of a binary write. passed down the write path instead of being kept in the document or nodes,
+// so writing the same document on multiple threads at once is safe.
+struct BinaryWriteContext
+{
+    CompressionOptions compression;
+    // compressed payloads of arrays. made by Document::compressProperties() beforehand, or on demand.
+    std::unordered_map<const Property*, RawVector<char>> compressed;
+
+    // sizes computed by Node::computeBinarySize() for Node::writeBinarySized()
+    struct NodeSize
+    {
+        uint64_t property_size;
+        uint64_t children_size;
+    };
+    std::unordered_map<const Node*, NodeSize> node_sizes;
+};
+
+// call body(i) for each i in [0, n) on worker threads and wait for completion.
+// the threads are a persistent pool shared by all calls. calls from inside body are allowed.
+// runs serially if sfbxEnableMultithreading is not defined. the first exception thrown by body is rethrown.
+void ParallelFor(size_t n, const std::function<void(size_t)>& body);
+
+
+// batches small writes into large chunks and flushes them to a std::ostream or a file.
+// positions are relative to where the writing started.
+class OutputBuffer
+{
+public:
+    static const size_t default_capacity = 1024 * 1024;
+
+    OutputBuffer();
+    explicit OutputBuffer(std::ostream& os);
+    ~OutputBuffer(); // flush() is called
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    // write to the file directly instead of std::ostream.
+    bool open(const char* path);
+    void close();
+
+    void write(const void* data, size_t size)
+    {
+        if (m_size + size <= m_buffer.size()) {
+            memcpy(m_buffer.data() + m_size, data, size);
+            m_size += size;
+        }
+        else {
+            writeSlow(data, size);
+        }
+    }
+    // write size bytes of c
+    void fill(char c, size_t size);
+
+    // overwrite already written data. requires isSeekable() if the data has been flushed.
+    void patch(uint64_t pos, const void* data, size_t size);
+
+    uint64_t tell() const;
+    bool isSeekable() const;
+    // returns false if any write so far has failed.
+    bool flush();
+
+private:
+    void flushBuffer();
+    void writeSlow(const void* data, size_t size);
+    bool writeToSink(const void* data, size_t size);
+    bool patchSink(uint64_t pos, const void* data, size_t size);
+
+    RawVector<char> m_buffer;
+    size_t m_size = 0; // size of buffered data
+    uint64_t m_flushed = 0; // size of data passed to the sink
+    bool m_seekable = false;
+    bool m_failed = false;
+
+    std::ostream* m_os{};
+    std::streamoff m_origin{};
+#ifdef _WIN32
+    void* m_file{};
+#else
+    int m_fd = -1;
+#endif
+};
+
 template<class T, sfbxRestrict(std::is_pod_v<T> && !std::is_pointer_v<T>)>
 inline void writev(std::ostream& os, T v)
 {
@@ -52,6 +196,31 @@ inline void writev(std::ostream& os, const T(&v)[N])
     writev(os, make_span(v));
 }
 
+template<class T, sfbxRestrict(std::is_pod_v<T> && !std::is_pointer_v<T>)>
+inline void writev(OutputBuffer& os, T v)
+{
+    os.write(&v, sizeof(T));
+}
+inline void writev(OutputBuffer& os, const void* src, size_t size)
+{
+    os.write(src, size);
+}
+template<class T>
+inline void writev(OutputBuffer& os, span<T> v)
+{
+    writev(os, v.data(), v.size_bytes());
+}
+template<class Cont, sfbxRestrict(is_contiguous_container<Cont>)>
+inline void writev(OutputBuffer& os, const Cont& v)
+{
+    writev(os, make_span(v));
+}
+template<class T, size_t N>
+inline void writev(OutputBuffer& os, const T(&v)[N])
+{
+    writev(os, make_span(v));
+}
+
 
 inline void AddTabs(std::string& dst, int n)
 {
@@ -191,26 +360,27 @@ inline auto FindObjectByName(const Cont& objects, string_view name)
 }
 
 
-class CounterStream : public std::ostream
+// memory-mapped file. pages are copy-on-write, so modifications are private to the process and never reach the file.
+class MemoryMappedFile
 {
 public:
-    CounterStream();
-    uint64_t size();
-    void reset();
-
-private:
-    class StreamBuf : public std::streambuf
-    {
-    public:
-        static char s_dummy_buf[1024];
+    MemoryMappedFile();
+    ~MemoryMappedFile();
+    MemoryMappedFile(const MemoryMappedFile&) = delete;
+    MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
 
-        StreamBuf();
-        int overflow(int c) override;
-        int sync() override;
-        void reset();
+    bool open(const char* path);
+    void close();
+    bool valid() const;
+    string_view getData() const;
 
-        uint64_t m_size = 0;
-    } m_buf;
+private:
+    const char* m_data{};
+    size_t m_size{};
+#ifdef _WIN32
+    void* m_file{};
+    void* m_mapping{};
+#endif
 };
 
 } // namespace sfbx
@@ -19,183 +19,524 @@ Node::Node(Node&& v) noexcept
 {
 }
 
-bool Node::readAscii(string_view& is)
+// ascii FBX doesn't tell element types of arrays. use the types binary FBX uses for known nodes,
+// so that arrays are allocated in their final types instead of float64 and converted later. others are float64.
+static PropertyType GetAsciiArrayType(string_view node_name)
 {
-    string_view line;
-    while (!is.empty()) {
-        line = get_line(is);
-        remove_leading_space(line);
-        if (line == "}")
-            return false;
-        else if (line == "{" || is_empty_line(line))
-            continue;
-        else
-            break;
-    }
-    {
-        size_t pos = line.find(':');
-        if (pos == -1)
-            return false;
-        m_name = read_n(line, pos);
-        skip_n(line, 1);
+    static const std::pair<string_view, PropertyType> s_table[]{
+        { sfbxS_PolygonVertexIndex, PropertyType::Int32Array },
+        { sfbxS_Edges, PropertyType::Int32Array },
+        { sfbxS_NormalsIndex, PropertyType::Int32Array },
+        { sfbxS_UVIndex, PropertyType::Int32Array },
+        { sfbxS_ColorIndex, PropertyType::Int32Array },
+        { sfbxS_Materials, PropertyType::Int32Array },
+        { sfbxS_Smoothing, PropertyType::Int32Array },
+        { sfbxS_Indexes, PropertyType::Int32Array },
+        { sfbxS_KeyTime, PropertyType::Int64Array },
+        { sfbxS_KeyValueFloat, PropertyType::Float32Array },
+        { sfbxS_KeyAttrFlags, PropertyType::Int32Array },
+        { sfbxS_KeyAttrDataFloat, PropertyType::Float32Array },
+        { sfbxS_KeyAttrRefCount, PropertyType::Int32Array },
+    };
+    for (auto& kvp : s_table) {
+        if (kvp.first == node_name)
+            return kvp.second;
     }
+    return PropertyType::Float64Array;
+}
+
+// event-driven ascii parser. Handler must have these:
+//  bool enterNode(string_view name); // return false to skip the node
+//  void addProperty(Property&& prop);
+//  void leaveNode(string_view name);
+//  bool readChildren(AsciiTokenizer& tk); // return true if the handler has read the children by itself
+// returns false if there is no node to read (end of data or end of the parent's block).
+template<class Handler>
+static bool ReadAsciiNodeImpl(AsciiTokenizer& tk, Handler& handler)
+{
+    using Type = AsciiToken::Type;
+
+    // "Name:" after empty lines
+    AsciiToken token;
+    do {
+        token = tk.next();
+    } while (token.type == Type::NewLine || token.type == Type::OpenBrace);
+    if (token.type != Type::Word || tk.next().type != Type::Colon)
+        return false;
 
+    string_view name = token.text;
+    bool enter = handler.enterNode(name);
+
+    // properties until the end of the line or '{'.
+    // long lists may be wrapped after or before ',' (legacy format does this).
     bool has_brace = false;
+    bool is_array = false;
     size_t array_size = 0;
-    if (!line.empty() && line.back() == '{') {
-        has_brace = true;
-        line.remove_suffix(1);
+    bool after_comma = false;
+    for (bool done = false; !done;) {
+        const char* pos = tk.tell();
+        token = tk.next();
+        switch (token.type) {
+        case Type::NewLine:
+            if (!after_comma) {
+                const char* line_pos = tk.tell();
+                if (tk.next().type == Type::Comma) {
+                    after_comma = true;
+                }
+                else {
+                    tk.seek(line_pos);
+                    done = true;
+                }
+            }
+            break;
+        case Type::End:
+            done = true;
+            break;
+        case Type::OpenBrace:
+            has_brace = true;
+            done = true;
+            break;
+        case Type::CloseBrace:
+            // end of the parent's block
+            tk.seek(pos);
+            done = true;
+            break;
+        case Type::Comma:
+            after_comma = true;
+            break;
+        case Type::Number:
+            after_comma = false;
+            if (enter) {
+                float64 number;
+                const char* end = token.text.data() + token.text.size();
+                if (parse_number(token.text.data(), end, number) != token.text.data()) {
+                    Property prop;
+                    prop.assign(number);
+                    handler.addProperty(std::move(prop));
+                }
+            }
+            break;
+        case Type::String:
+            after_comma = false;
+            if (enter) {
+                Property prop;
+                string_view str = token.text;
+                auto pos = str.find("::");
+                if (pos != std::string::npos) // str is in full name format
+                    prop.assign(MakeFullName(str.substr(pos + 2), str.substr(0, pos)));
+                else
+                    prop.assign(str);
+                handler.addProperty(std::move(prop));
+            }
+            break;
+        case Type::ArraySize:
+            after_comma = false;
+            is_array = to_array_size(token.text, array_size);
+            break;
+        default:
+            after_comma = false;
+            break;
+        }
     }
 
-    // parse properties
-    split(line, ",", [&](string_view elem) {
-        if (elem.empty())
-            return;
-
-        float64 number;
-        string_view str;
-        size_t size;
-        if (to_number(elem, number)) { // number
-            addProperty(number);
-        }
-        else if (to_string(elem, str)) { // string
-            auto pos = str.find("::");
-            if (pos != std::string::npos) // str is in full name format
-                addProperty(MakeFullName(str.substr(pos + 2), str.substr(0, pos)));
-            else
-                addProperty(str);
-        }
-        else if (to_array_size(elem, size)) { // array
-            array_size = size;
-        }
-        });
+    if (!enter) {
+        if (has_brace)
+            tk.skipBlock();
+        return true;
+    }
 
     if (has_brace) { // parse inside '{'
-        if (array_size != 0) { // array
-            auto dst = createProperty()->allocateArray<float64>(array_size);
-            float64 d;
-
-            read_until(is, "a:", true);
-            for (size_t i = 0; i < array_size; ++i) {
-                to_number(is, d);
-                dst[i] = d;
-                if (i != array_size - 1)
-                    read_until(is, ",", true);
+        if (is_array) { // "a: v0,v1,...}"
+            do {
+                token = tk.next();
+            } while (token.type == Type::NewLine);
+            if (token.type != Type::Word || token.text != "a" || tk.next().type != Type::Colon)
+                throw std::runtime_error("sfbx::ReadAsciiNode(): invalid array");
+
+            auto read_array = [&](auto type_tag) {
+                Property prop;
+                auto dst = prop.allocateArray<decltype(type_tag)>(array_size);
+                if (tk.readArray(dst) < array_size)
+                    throw std::runtime_error("sfbx::ReadAsciiNode(): array is shorter than its size");
+                handler.addProperty(std::move(prop));
+            };
+            switch (GetAsciiArrayType(name)) {
+            case PropertyType::Int32Array: read_array(int32{}); break;
+            case PropertyType::Int64Array: read_array(int64{}); break;
+            case PropertyType::Float32Array: read_array(float32{}); break;
+            default: read_array(float64{}); break;
             }
-            read_until(is, "}", false);
-            get_line(is);
         }
-        else { // child nodes
-            for (;;) {
-                Node* child = createChild();
-                child->readAscii(is);
-                if (child->isNull()) {
-                    eraseChild(child);
-                    break;
-                }
-            }
+        else if (!handler.readChildren(tk)) { // child nodes
+            while (ReadAsciiNodeImpl(tk, handler)) {}
         }
     }
+    handler.leaveNode(name);
     return true;
 }
 
+bool ReadAsciiNode(string_view& is, NodeVisitor& visitor)
+{
+    struct Handler
+    {
+        NodeVisitor& visitor;
+
+        bool enterNode(string_view name) { return visitor.enterNode(name); }
+        void addProperty(Property&& prop) { visitor.visitProperty(prop); }
+        void leaveNode(string_view name) { visitor.leaveNode(name); }
+        bool readChildren(AsciiTokenizer& /*tk*/) { return false; }
+    } handler{ visitor };
+
+    AsciiTokenizer tk(is);
+    bool ret = ReadAsciiNodeImpl(tk, handler);
+    is = tk.getRemaining();
+    return ret;
+}
+
+bool SkipAsciiNode(AsciiTokenizer& tk, string_view& name)
+{
+    struct Handler
+    {
+        string_view& name;
+
+        bool enterNode(string_view n) { name = n; return false; }
+        void addProperty(Property&& /*prop*/) {}
+        void leaveNode(string_view /*n*/) {}
+        bool readChildren(AsciiTokenizer& /*tk*/) { return false; }
+    } handler{ name };
+    return ReadAsciiNodeImpl(tk, handler);
+}
+
+bool Node::readAscii(string_view& is)
+{
+    AsciiTokenizer tk(is);
+    bool ret = readAscii(tk);
+    is = tk.getRemaining();
+    return ret;
+}
+
+bool Node::readAscii(AsciiTokenizer& tk, std::vector<NodePtr>* storage)
+{
+    // build node tree. this node is the root of it.
+    struct Handler
+    {
+        Node* root;
+        Node* current;
+        std::vector<NodePtr>* storage;
+
+        bool enterNode(string_view name)
+        {
+            // see LoadOptions::skip_nodes and skip_objects
+            Node* parent = current ? current : root->m_parent;
+            if (root->m_document && root->m_document->isSkippedNode(parent, name))
+                return false;
+
+            if (!current)
+                current = root;
+            else
+                current = storage ? current->createChild(*storage) : current->createChild();
+            current->m_name = name;
+            return true;
+        }
+        void addProperty(Property&& prop) { current->m_properties.push_back(std::move(prop)); }
+        void leaveNode(string_view /*name*/) { current = current->m_parent; }
+        bool readChildren(AsciiTokenizer& tk)
+        {
+            auto doc = root->m_document;
+            if (!storage && doc && doc->getLoadOptions().parallel && current->isRoot() && current->m_name == sfbxS_Objects) {
+                current->readAsciiChildrenParallel(tk);
+                return true;
+            }
+            return false;
+        }
+    } handler{ this, nullptr, storage };
+    return ReadAsciiNodeImpl(tk, handler);
+}
+
 bool Node::writeAscii(std::ostream& os, int depth) const
+{
+    OutputBuffer buf(os);
+    std::string text;
+    bool ret = writeAscii(buf, text, depth);
+    buf.write(text.data(), text.size());
+    return buf.flush() && ret;
+}
+
+bool Node::writeAscii(OutputBuffer& os, std::string& text, int depth) const
 {
     if (isNull())
         return false;
 
-    {
-        std::string s;
-        AddTabs(s, depth);
-        s += getName();
-        s += ": ";
-        join(s, m_properties, ", ",
-            [depth](std::string& dst, const Property& p) { p.toString(dst, depth); });
-        s += " ";
-        os << s;
-    }
+    // text accumulates the output of nodes and is passed to os in large blocks.
+    // it keeps its capacity, so no allocations happen once it has grown.
+    auto flush = [&]() {
+        if (text.size() >= OutputBuffer::default_capacity) {
+            os.write(text.data(), text.size());
+            text.clear();
+        }
+    };
+
+    AddTabs(text, depth);
+    text += getName();
+    text += ": ";
+    join(text, m_properties, ", ",
+        [depth](std::string& dst, const Property& p) { p.toString(dst, depth); });
+    text += " ";
+    flush();
 
     if (isNullTerminated()) {
-        os << "{\n";
+        text += "{\n";
         for (auto* c : m_children)
-            c->writeAscii(os, depth + 1);
-        for (int i = 0; i < depth; ++i)
-            os << "\t";
-        os << "}";
+            c->writeAscii(os, text, depth + 1);
+        AddTabs(text, depth);
+        text += "}";
     }
-    os << "\n";
+    text += "\n";
+    flush();
     return true;
 }
 
-uint64_t Node::readBinary(std::istream& is, uint64_t start_offset)
+uint64_t ReadBinaryNodeHeader(string_view& is, uint32_t version, BinaryNodeHeader& dst)
 {
     uint64_t ret = 0;
-
-    uint64_t end_offset, num_props, prop_size;
-    if (getDocumentVersion() >= sfbxI_FBX2016_FileVersion) {
+    if (version >= sfbxI_FBX2016_FileVersion) {
         // size records are 64bit since FBX 2016
-        end_offset = read1<uint64_t>(is);
-        num_props = read1<uint64_t>(is);
-        prop_size = read1<uint64_t>(is);
+        dst.end_offset = read1<uint64_t>(is);
+        dst.num_props = read1<uint64_t>(is);
+        dst.prop_size = read1<uint64_t>(is);
         ret += 24;
     }
     else {
-        end_offset = read1<uint32_t>(is);
-        num_props = read1<uint32_t>(is);
-        prop_size = read1<uint32_t>(is);
+        dst.end_offset = read1<uint32_t>(is);
+        dst.num_props = read1<uint32_t>(is);
+        dst.prop_size = read1<uint32_t>(is);
         ret += 12;
     }
 
     uint8_t name_len = read1<uint8_t>(is);
-    readv(is, m_name, name_len);
+    dst.name = readv(is, name_len);
     ret += 1;
     ret += name_len;
+    return ret;
+}
+
+uint64_t SkipBinaryNode(string_view& is, uint64_t start_offset, const BinaryNodeHeader& header)
+{
+    if (header.end_offset <= start_offset || header.end_offset - start_offset > is.size())
+        throw std::runtime_error("sfbx::SkipBinaryNode(): invalid end offset");
+    uint64_t size = header.end_offset - start_offset;
+    is.remove_prefix(size);
+    return size;
+}
 
+uint64_t Node::readBinary(string_view& is, uint64_t start_offset)
+{
+    return readBinary(is, start_offset, nullptr);
+}
+
+uint64_t Node::readBinary(string_view& is, uint64_t start_offset, std::vector<NodePtr>* storage)
+{
+    BinaryNodeHeader header;
+    uint64_t ret = ReadBinaryNodeHeader(is, getDocumentVersion(), header);
+    uint64_t end_offset = header.end_offset;
+    uint64_t num_props = header.num_props;
+    uint64_t prop_size = header.prop_size;
+    m_name = header.name;
+
+    // if parallel, compressed arrays are inflated later by Document::readBinary() at once.
+    // worker threads (storage is not null) inflate them by themselves.
+    auto& opt = m_document->getLoadOptions();
+    bool lazy_decompression = opt.lazy_decompression || (opt.parallel && !storage);
     reserveProperties(num_props);
     for (uint32_t i = 0; i < num_props; i++)
-        createProperty()->read(is);
+        createProperty()->read(is, lazy_decompression);
     ret += prop_size;
 
+    if (!storage && opt.parallel && isRoot() && m_name == sfbxS_Objects) {
+        ret += readBinaryChildrenParallel(is, start_offset + ret, end_offset);
+        return ret;
+    }
+
+    uint32_t version = getDocumentVersion();
     while (start_offset + ret < end_offset) {
-        auto child = createChild();
-        ret += child->readBinary(is, start_offset + ret);
-        if (child->isNull())
-            eraseChild(child);
+        // peek the header to handle null record and skipped nodes without creating nodes
+        string_view tmp = is;
+        BinaryNodeHeader child_header;
+        uint64_t child_header_size = ReadBinaryNodeHeader(tmp, version, child_header);
+        if (child_header.end_offset == 0) {
+            // null record. terminates the children.
+            is = tmp;
+            ret += child_header_size;
+            continue;
+        }
+        if (m_document->isSkippedNode(this, child_header.name)) {
+            ret += SkipBinaryNode(is, start_offset + ret, child_header);
+            continue;
+        }
+
+        auto child = storage ? createChild(*storage) : createChild();
+        ret += child->readBinary(is, start_offset + ret, storage);
     }
     return ret;
 }
 
-uint64_t Node::writeBinary(std::ostream& os, uint64_t start_offset)
+uint64_t Node::readBinaryChildrenParallel(string_view& is, uint64_t start_offset, uint64_t end_offset)
 {
-    uint32_t header_size = getHeaderSize() + m_name.size();
-    if (isNull()) {
-        for (uint32_t i = 0; i < header_size; i++)
-            writev(os, (uint8_t)0);
-        return header_size;
+    struct Record
+    {
+        string_view data;
+        uint64_t offset;
+        std::vector<NodePtr> nodes; // the child and its descendants
+    };
+
+    // index pre-pass. records are self-delimiting by end_offset, so children can be located without parsing them.
+    std::vector<Record> records;
+    uint32_t version = getDocumentVersion();
+    uint64_t pos = start_offset;
+    while (pos < end_offset) {
+        string_view tmp = is;
+        BinaryNodeHeader child_header;
+        uint64_t child_header_size = ReadBinaryNodeHeader(tmp, version, child_header);
+        if (child_header.end_offset == 0) {
+            is = tmp;
+            pos += child_header_size;
+            continue;
+        }
+
+        string_view data = is;
+        uint64_t size = SkipBinaryNode(is, pos, child_header);
+        if (!m_document->isSkippedNode(this, child_header.name))
+            records.push_back({ data.substr(0, size), pos, {} });
+        pos += size;
     }
 
-    Node null_node;
-    null_node.m_document = m_document;
+    // parse subtrees in parallel. each of them has own node storage.
+    // children are not linked yet. records own them and are gone if a worker throws.
+    for (auto& r : records)
+        createChild(r.nodes, false);
+    ParallelFor(records.size(), [&](size_t i) {
+        auto& r = records[i];
+        r.nodes.front()->readBinary(r.data, r.offset, &r.nodes);
+    });
+
+    // merge. the order of nodes is the same as sequential parsing.
+    size_t num_nodes = 0;
+    for (auto& r : records)
+        num_nodes += r.nodes.size();
+    m_document->reserveNodes(num_nodes);
+    m_children.reserve(m_children.size() + records.size());
+    for (auto& r : records) {
+        m_children.push_back(r.nodes.front().get());
+        m_document->addNodes(r.nodes);
+    }
+    return pos - start_offset;
+}
 
-    uint64_t property_size = 0;
-    uint64_t children_size = 0;
-    bool null_terminate = isNullTerminated();
+void Node::readAsciiChildrenParallel(AsciiTokenizer& tk)
+{
+    struct Record
     {
-        CounterStream cs;
-        for (auto& prop : m_properties)
-            prop.write(cs);
-        property_size = cs.size();
+        string_view data;
+        std::vector<NodePtr> nodes; // the child and its descendants
+    };
+
+    // index pre-pass. children are skipped without building nodes to find where each of them is.
+    // this stops at the '}' of this node as sequential parsing does.
+    std::vector<Record> records;
+    for (;;) {
+        const char* begin = tk.tell();
+        string_view name;
+        if (!SkipAsciiNode(tk, name))
+            break;
+        if (!m_document->isSkippedNode(this, name))
+            records.push_back({ make_view(begin, tk.tell()), {} });
     }
-    {
-        CounterStream cs;
-        for (auto child : m_children)
-            child->writeBinary(cs, 0);
-        if (null_terminate)
-            null_node.writeBinary(cs, 0);
-        children_size = cs.size();
+
+    // parse subtrees in parallel. each of them has own node storage.
+    // children are linked after that as readBinaryChildrenParallel() does.
+    for (auto& r : records)
+        createChild(r.nodes, false);
+    ParallelFor(records.size(), [&](size_t i) {
+        auto& r = records[i];
+        AsciiTokenizer child_tk(r.data);
+        r.nodes.front()->readAscii(child_tk, &r.nodes);
+    });
+
+    // merge. the order of nodes is the same as sequential parsing.
+    size_t num_nodes = 0;
+    for (auto& r : records)
+        num_nodes += r.nodes.size();
+    m_document->reserveNodes(num_nodes);
+    m_children.reserve(m_children.size() + records.size());
+    for (auto& r : records) {
+        m_children.push_back(r.nodes.front().get());
+        m_document->addNodes(r.nodes);
     }
+}
 
-    uint64_t end_offset = start_offset + header_size + property_size + children_size;
+uint64_t Node::writeBinary(std::ostream& os, uint64_t start_offset)
+{
+    OutputBuffer buf(os);
+    BinaryWriteContext ctx;
+    return writeBinary(buf, start_offset, ctx);
+}
+
+uint64_t Node::writeBinary(OutputBuffer& os, uint64_t start_offset, BinaryWriteContext& ctx) const
+{
+    // seekable stream: write placeholders and patch them once the children are written.
+    // otherwise (e.g. pipe): sizes of all descendants are computed once first, bottom-up.
+    if (os.isSeekable())
+        return writeBinaryPatched(os, start_offset, ctx);
+
+    computeBinarySize(ctx);
+    return writeBinarySized(os, start_offset, ctx);
+}
+
+// arrays are compressed once and the result is kept in ctx until the property is written.
+static uint64_t GetBinarySize(const Property& prop, BinaryWriteContext& ctx)
+{
+    if (!prop.isArray())
+        return prop.getBinarySize(ctx.compression);
+    return prop.getBinarySize(ctx.compression, ctx.compressed[&prop]);
+}
+
+static void WriteProperty(OutputBuffer& os, const Property& prop, BinaryWriteContext& ctx)
+{
+    if (!prop.isArray()) {
+        prop.write(os, ctx.compression);
+        return;
+    }
+    auto it = ctx.compressed.find(&prop);
+    if (it != ctx.compressed.end()) {
+        prop.write(os, ctx.compression, it->second);
+        ctx.compressed.erase(it); // no longer needed
+    }
+    else {
+        prop.write(os, ctx.compression);
+    }
+}
+
+uint64_t Node::computeBinarySize(BinaryWriteContext& ctx) const
+{
+    uint32_t header_size = getHeaderSize() + m_name.size();
+    if (isNull())
+        return header_size;
+
+    BinaryWriteContext::NodeSize size{};
+    for (auto& prop : m_properties)
+        size.property_size += GetBinarySize(prop, ctx);
+
+    for (auto child : m_children)
+        size.children_size += child->computeBinarySize(ctx);
+    if (isNullTerminated())
+        size.children_size += getHeaderSize(); // null record
+
+    ctx.node_sizes[this] = size;
+    return header_size + size.property_size + size.children_size;
+}
+
+void Node::writeBinaryHeader(OutputBuffer& os, uint64_t end_offset, uint64_t property_size) const
+{
     if (getDocumentVersion() >= sfbxI_FBX2016_FileVersion) {
         // size records are 64bit since FBX 2016
         writev(os, uint64_t(end_offset));
@@ -209,15 +550,69 @@ uint64_t Node::writeBinary(std::ostream& os, uint64_t start_offset)
     }
     writev(os, uint8_t(m_name.size()));
     writev(os, m_name);
+}
+
+uint64_t Node::writeBinarySized(OutputBuffer& os, uint64_t start_offset, BinaryWriteContext& ctx) const
+{
+    uint32_t header_size = getHeaderSize() + m_name.size();
+    if (isNull()) {
+        os.fill(0, header_size);
+        return header_size;
+    }
+
+    auto size = ctx.node_sizes[this];
+    writeBinaryHeader(os, start_offset + header_size + size.property_size + size.children_size, size.property_size);
+    for (auto& prop : m_properties)
+        WriteProperty(os, prop, ctx);
+
+    uint64_t pos = header_size + size.property_size;
+    for (auto child : m_children)
+        pos += child->writeBinarySized(os, start_offset + pos, ctx);
+    if (isNullTerminated()) {
+        os.fill(0, getHeaderSize());
+        pos += getHeaderSize();
+    }
+    return pos;
+}
+
+uint64_t Node::writeBinaryPatched(OutputBuffer& os, uint64_t start_offset, BinaryWriteContext& ctx) const
+{
+    uint32_t header_size = getHeaderSize() + m_name.size();
+    if (isNull()) {
+        os.fill(0, header_size);
+        return header_size;
+    }
 
+    // property size is cheap to get. (compressed arrays are kept in ctx for WriteProperty())
+    uint64_t property_size = 0;
     for (auto& prop : m_properties)
-        prop.write(os);
+        property_size += GetBinarySize(prop, ctx);
+
+    // end_offset is a placeholder if the node has children
+    uint64_t header_pos = os.tell();
+    writeBinaryHeader(os, start_offset + header_size + property_size, property_size);
+    for (auto& prop : m_properties)
+        WriteProperty(os, prop, ctx);
 
     uint64_t pos = header_size + property_size;
+    if (!isNullTerminated())
+        return pos;
+
     for (auto child : m_children)
-        pos += child->writeBinary(os, start_offset + pos);
-    if (null_terminate)
-        pos += null_node.writeBinary(os, start_offset + pos);
+        pos += child->writeBinaryPatched(os, start_offset + pos, ctx);
+    os.fill(0, getHeaderSize());
+    pos += getHeaderSize();
+
+    // patch end_offset. this is usually still in the buffer and no actual seek happens.
+    uint64_t end_offset = start_offset + pos;
+    if (getDocumentVersion() >= sfbxI_FBX2016_FileVersion) {
+        uint64_t v = end_offset;
+        os.patch(header_pos, &v, sizeof(v));
+    }
+    else {
+        uint32_t v = uint32_t(end_offset);
+        os.patch(header_pos, &v, sizeof(v));
+    }
     return pos;
 }
 
@@ -260,6 +655,17 @@ Node* Node::createChild(string_view name)
     return p;
 }
 
+Node* Node::createChild(std::vector<NodePtr>& storage, bool link)
+{
+    storage.push_back(std::make_shared<Node>());
+    auto p = storage.back().get();
+    p->m_document = m_document;
+    p->m_parent = this;
+    if (link)
+        m_children.push_back(p);
+    return p;
+}
+
 void Node::eraseChild(Node* n)
 {
     m_document->eraseNode(n);
@@ -348,6 +754,11 @@ uint32_t Node::getDocumentVersion() const
     return (uint32_t)m_document->getFileVersion();
 }
 
+bool Node::isDeferringArrays() const
+{
+    return m_document && m_document->getExportOptions().refer_object_data;
+}
+
 uint32_t Node::getHeaderSize() const
 {
     if (getDocumentVersion() >= sfbxI_FBX2016_FileVersion) {
@@ -3,6 +3,9 @@
 
 namespace sfbx {
 
+class AsciiTokenizer;
+struct BinaryWriteContext;
+
 class Node
 {
 friend class Document;
@@ -12,7 +15,7 @@ public:
     Node(const Node&) = delete;
     Node& operator=(const Node&) = delete;
 
-    uint64_t readBinary(std::istream& is, uint64_t start_offset);
+    uint64_t readBinary(string_view& is, uint64_t start_offset);
     uint64_t writeBinary(std::ostream& os, uint64_t start_offset);
 
     bool readAscii(string_view& is);
@@ -31,6 +34,8 @@ public:
 
     // utils
     template<class T> void addProperty(const T& v) { createProperty()->assign(v); }
+    // arrays via array_adaptor are deferred during export if ExportOptions::refer_object_data is set.
+    template<class D, class S> void addProperty(const array_adaptor<D, S>& v) { if (isDeferringArrays()) createProperty()->assignDeferred(v); else createProperty()->assign(v); }
     template<class... T> void addProperties(T&&... v) { reserveProperties(getProperties().size() + sizeof...(T));  addProperties_(v...); }
     template<class... T> Node* createChild(string_view name, T&&... v) { auto r = createChild(name);  r->addProperties(v...); return r; }
 
@@ -51,6 +56,22 @@ private:
     void addProperties_() {}
     template<class T, class... U> void addProperties_(T&& v, U&&... a) { addProperty(v); addProperties_(a...); }
 
+    // storage: where descendants are created instead of the document. used by worker threads.
+    uint64_t readBinary(string_view& is, uint64_t start_offset, std::vector<NodePtr>* storage);
+    bool readAscii(AsciiTokenizer& tk, std::vector<NodePtr>* storage = nullptr);
+    uint64_t readBinaryChildrenParallel(string_view& is, uint64_t start_offset, uint64_t end_offset);
+    void readAsciiChildrenParallel(AsciiTokenizer& tk);
+    // link: add the child to m_children. parallel readers link children after all of them are parsed successfully.
+    Node* createChild(std::vector<NodePtr>& storage, bool link = true);
+    uint64_t computeBinarySize(BinaryWriteContext& ctx) const;
+    uint64_t writeBinary(OutputBuffer& os, uint64_t start_offset, BinaryWriteContext& ctx) const;
+    void writeBinaryHeader(OutputBuffer& os, uint64_t end_offset, uint64_t property_size) const;
+    // sized: requires computeBinarySize(). patched: requires seekable output.
+    uint64_t writeBinarySized(OutputBuffer& os, uint64_t start_offset, BinaryWriteContext& ctx) const;
+    uint64_t writeBinaryPatched(OutputBuffer& os, uint64_t start_offset, BinaryWriteContext& ctx) const;
+    bool writeAscii(OutputBuffer& os, std::string& text, int depth) const;
+
+    bool isDeferringArrays() const;
     uint32_t getDocumentVersion() const;
     uint32_t getHeaderSize() const;
     bool isNullTerminated() const;
@@ -1,57 +1,99 @@
 #pragma once
+#include <charconv>
+#include <limits>
+#include <stdexcept>
 
-//// gcc/clang still don't support std::to_chars for float...
-//#define sfbxUseCharconv
+// std::to_chars() and std::from_chars() for floating point numbers are available since gcc 11 and VS2019 16.4
+#if defined(__cpp_lib_to_chars) || (defined(_MSC_VER) && _MSC_VER >= 1924)
+    #define sfbxUseCharconv
+#endif
 
 namespace sfbx {
 
+// buffer size enough for any number formatted by format_number()
+constexpr size_t max_number_chars = 32;
+
+// write v to dst and return the end. floats are the shortest representation that reads back to the same value.
+template<class T, sfbxRestrict(std::is_integral_v<T>)>
+inline char* format_number(char* dst, T v)
+{
+    return std::to_chars(dst, dst + max_number_chars, v).ptr;
+}
+
 #ifdef sfbxUseCharconv
-template<class Value>
-inline void append(std::string& dst, Value v)
+template<class T, sfbxRestrict(std::is_floating_point_v<T>)>
+inline char* format_number(char* dst, T v)
 {
-    char buf[64];
-    auto ret = std::to_chars(buf, buf + std::size(buf), v);
-    if (ret.ec == std::errc{})
-        dst.append(buf, ret.ptr);
+    return std::to_chars(dst, dst + max_number_chars, v).ptr;
 }
 #else
-
-inline void append(std::string& dst, int16 v)
+inline char* format_number(char* dst, float32 v)
 {
-    char buf[64];
-    sprintf(buf, "%hd", v);
-    dst += buf;
+    // increase precision until it round-trips
+    int len = 0;
+    for (int precision = 6; precision <= 9; ++precision) {
+        len = snprintf(dst, max_number_chars, "%.*g", precision, v);
+        if (std::strtof(dst, nullptr) == v)
+            break;
+    }
+    return dst + len;
 }
-inline void append(std::string& dst, int32 v)
+inline char* format_number(char* dst, float64 v)
 {
-    char buf[64];
-    sprintf(buf, "%d", v);
-    dst += buf;
+    int len = 0;
+    for (int precision = 15; precision <= 17; ++precision) {
+        len = snprintf(dst, max_number_chars, "%.*g", precision, v);
+        if (std::strtod(dst, nullptr) == v)
+            break;
+    }
+    return dst + len;
 }
-inline void append(std::string& dst, int64 v)
+#endif
+
+template<class T, sfbxRestrict(std::is_arithmetic_v<T>)>
+inline void append(std::string& dst, T v)
 {
-    char buf[64];
-    sprintf(buf, "%lld", v);
-    dst += buf;
+    char buf[max_number_chars];
+    dst.append(buf, format_number(buf, v));
 }
-inline void append(std::string& dst, float32 v)
+
+inline void append(std::string& dst, boolean v)
 {
-    char buf[64];
-    sprintf(buf, "%g", v);
-    dst += buf;
+    dst += v.value;
 }
-inline void append(std::string& dst, float64 v)
+
+
+// scanning primitives. the loops below spend most of their time finding a few characters in long runs of data,
+// so the search is done by memchr() or 16 bytes at a time with SSE2 / NEON, and the match is verified after that.
+
+// returns end if not found.
+inline const char* find_char(const char* begin, const char* end, char c)
 {
-    char buf[64];
-    sprintf(buf, "%lg", v);
-    dst += buf;
+    if (begin == end)
+        return end;
+    auto r = (const char*)memchr(begin, c, end - begin);
+    return r ? r : end;
 }
 
-#endif
+// find the first of chars (up to 4 characters). returns end if not found.
+// vectorized with SSE2 or NEON if available. implemented in sfbxUtils.cpp.
+const char* find_first_of(const char* begin, const char* end, string_view chars);
 
-inline void append(std::string& dst, boolean v)
+// same as str.find(sub). the first character is searched by find_char() and the rest is compared at the candidates.
+inline size_t find_string(string_view str, string_view sub)
 {
-    dst += v.value;
+    if (sub.empty())
+        return 0;
+    if (sub.size() > str.size())
+        return string_view::npos;
+
+    const char* begin = str.data();
+    const char* last = begin + (str.size() - sub.size()) + 1; // end of the candidates
+    for (const char* p = begin; (p = find_char(p, last, sub.front())) != last; ++p) {
+        if (memcmp(p + 1, sub.data() + 1, sub.size() - 1) == 0)
+            return p - begin;
+    }
+    return string_view::npos;
 }
 
 
@@ -90,8 +132,31 @@ inline void join(String& dst, const Container& cont, typename String::const_poin
 template<class String, class Container>
 inline void join(String& dst, const Container& cont, const char* sep)
 {
-    join(dst, cont, sep,
-        [](String& dst, typename Container::const_reference v) { append(dst, v); });
+    using value_type = std::remove_const_t<typename Container::value_type>;
+    if constexpr (std::is_arithmetic_v<value_type>) {
+        // format numbers directly into dst block by block. much faster than appending them one by one.
+        const size_t block_size = 1024;
+        const size_t sep_len = std::strlen(sep);
+        const size_t n = cont.size();
+        for (size_t bi = 0; bi < n; bi += block_size) {
+            size_t bn = std::min(block_size, n - bi);
+            size_t pos = dst.size();
+            dst.resize(pos + bn * (max_number_chars + sep_len));
+            char* p = &dst[pos];
+            for (size_t i = bi; i < bi + bn; ++i) {
+                if (i != 0) {
+                    memcpy(p, sep, sep_len);
+                    p += sep_len;
+                }
+                p = format_number(p, cont[i]);
+            }
+            dst.resize(p - dst.data());
+        }
+    }
+    else {
+        join(dst, cont, sep,
+            [](String& dst, typename Container::const_reference v) { append(dst, v); });
+    }
 }
 
 
@@ -100,7 +165,7 @@ inline void split(string_view line, string_view sep, const Body& body)
 {
     auto range = line;
     for (;;) {
-        size_t pos = range.find(sep);
+        size_t pos = find_string(range, sep);
         if (pos != std::string::npos) {
             auto sub = range.substr(0, pos);
             body(remove_space(sub));
@@ -123,113 +188,81 @@ inline std::vector<string_view> split(string_view line, string_view sep)
 
 inline string_view get_line(string_view& str)
 {
-    size_t len = str.size();
-    for (size_t i = 0; i < len; ++i) {
-        if (str[i] == '\n' || str[i] == '\r') {
-            auto ret = str.substr(0, i);
-            str.remove_prefix(i + 1);
-            if (!str.empty() && str.front() == '\n')
-                str.remove_prefix(1);
-            return ret;
-        }
+    const char* end = str.data() + str.size();
+    const char* p = find_first_of(str.data(), end, "\n\r");
+    auto ret = make_view(str.data(), p);
+    if (p != end) {
+        ++p;
+        if (p != end && *p == '\n')
+            ++p;
     }
-
-    auto ret = str;
-    str.remove_prefix(str.size());
+    str = make_view(p, end);
     return ret;
 }
 
-inline std::string read_brace_block(std::istream& is)
+// find the '}' that closes nest levels of blocks at p and return the position next to it, or end if not closed.
+// braces in quoted strings and comments (';' to the end of the line) don't count.
+inline const char* find_closing_brace(const char* p, const char* end, int nest = 1)
 {
-    std::string ret;
-    std::string line;
-    auto add_line = [&]() {
-        ret += line;
-        ret += '\n';
-    };
-
-    int nest = 0;
-
-    bool end = false;
-    while (!is.eof()) {
-        std::getline(is, line);
-
-        if (line.find('{') != std::string::npos) {
+    while (nest > 0 && (p = find_first_of(p, end, "{}\";")) != end) {
+        char c = *p++;
+        if (c == '{')
             ++nest;
-            add_line();
-        }
-        else if (line.find('}') != std::string::npos) {
-            add_line();
-            if (--nest == 0)
-                break;
-        }
+        else if (c == '}')
+            --nest;
         else {
-            if (nest > 0)
-                add_line();
+            p = find_char(p, end, c == '"' ? '"' : '\n');
+            if (p != end)
+                ++p;
         }
     }
-    return ret;
+    return p;
 }
 
+// read a block from the line with the first '{' to the line with the matching '}'. returns a view of is.
 inline string_view read_brace_block(string_view& is)
 {
-    string_view ret;
-    size_t block_begin = 0;
-    size_t block_end = 0;
-    int nest = 0;
-
-    bool end = false;
-    size_t pos = 0;
-    while (pos < is.size() && !end) {
-        char c = is[pos];
-
-        if (c == '{') {
-            if (nest++ == 0) {
-                block_begin = pos;
-            }
-        }
-        else if (c == '}') {
-            if (--nest == 0) {
-                end = true;
-                block_end = pos + 1;
-            }
-        }
-        ++pos;
-    }
-
-    if (block_end >= block_begin) {
-        auto ret = is.substr(block_begin, block_end - block_begin);
-        is.remove_prefix(block_end);
-        return ret;
+    const char* begin = is.data();
+    const char* end = begin + is.size();
+
+    // first '{' outside strings and comments
+    const char* brace = begin;
+    while ((brace = find_first_of(brace, end, "{\";")) != end && *brace != '{') {
+        brace = find_char(brace + 1, end, *brace == '"' ? '"' : '\n');
+        if (brace != end)
+            ++brace;
     }
-    else {
+    if (brace == end) {
+        is = make_view(end, end);
         return {};
     }
+
+    const char* line_begin = brace;
+    while (line_begin != begin && line_begin[-1] != '\n' && line_begin[-1] != '\r')
+        --line_begin;
+    is = make_view(find_closing_brace(brace + 1, end), end);
+    get_line(is); // the rest of the line with '}'
+    return make_view(line_begin, is.data());
+}
+
+// skip the rest of a block whose '{' is already consumed. is points to the next line of '}' after this.
+inline void skip_brace_block(string_view& is)
+{
+    const char* end = is.data() + is.size();
+    is = make_view(find_closing_brace(is.data(), end), end);
+    get_line(is);
 }
 
 inline string_view read_until(string_view& is, string_view delim, bool include_delim)
 {
-    size_t src_size = is.size();
-    size_t delim_size = delim.size();
-    if (src_size < delim_size)
+    size_t pos = find_string(is, delim);
+    if (pos == string_view::npos)
         return {};
 
-    size_t count = src_size - delim_size;
-    for (size_t i = 0; i < count; ++i) {
-        if (is.substr(i, delim_size) == delim) {
-            if (include_delim) {
-                auto ret = is.substr(0, i + delim_size);
-                is.remove_prefix(i + delim_size);
-                return ret;
-            }
-            else {
-                auto ret = is.substr(0, i);
-                is.remove_prefix(i);
-                return ret;
-            }
-        }
-    }
-    return {};
+    size_t n = include_delim ? pos + delim.size() : pos;
+    auto ret = is.substr(0, n);
+    is.remove_prefix(n);
+    return ret;
 }
 
 inline string_view read_n(string_view& is, size_t n)
@@ -297,4 +330,242 @@ inline bool to_array_size(string_view str, size_t& dst)
     }
     return false;
 }
+
+// true if v is in the range of T. integer conversions of out-of-range values are undefined.
+template<class T, class V>
+inline bool in_range(V v)
+{
+    if constexpr (std::is_floating_point_v<T>) {
+        return true;
+    }
+    else if constexpr (std::is_floating_point_v<V>) {
+        // max() + 1 is a power of 2 and exact in V while max() may not be. also false for nan.
+        return v >= V(std::numeric_limits<T>::min()) && v < V(std::numeric_limits<T>::max()) + 1;
+    }
+    else {
+        return v >= std::numeric_limits<T>::min() && v <= std::numeric_limits<T>::max();
+    }
+}
+
+// parse a number at the beginning of [begin, end) and return the end of it. returns begin if it is not a number,
+// and nullptr if it is a number but out of the range of T.
+// plain integers (the majority in arrays) take a fast path. others are parsed by std::from_chars() if available.
+template<class T, sfbxRestrict(std::is_arithmetic_v<T>)>
+inline const char* parse_number(const char* begin, const char* end, T& dst)
+{
+    const char* p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    // up to 18 digits never overflow uint64_t
+    const char* digits = p;
+    uint64_t value = 0;
+    while (p < end && p - digits < 18 && unsigned(*p - '0') < 10u) {
+        value = value * 10 + unsigned(*p - '0');
+        ++p;
+    }
+    auto is_float_part = [](char c) { return unsigned(c - '0') < 10u || c == '.' || c == 'e' || c == 'E'; };
+    if (p != digits && (p == end || !is_float_part(*p))) {
+        if constexpr (std::is_floating_point_v<T>) {
+            dst = negative ? -T(value) : T(value); // negate after the conversion to keep -0
+        }
+        else {
+            int64 v = negative ? -int64(value) : int64(value);
+            if (!in_range<T>(v))
+                return nullptr;
+            dst = T(v);
+        }
+        return p;
+    }
+
+    const char* first = begin < end && *begin == '+' ? begin + 1 : begin; // from_chars() doesn't accept '+'
+    if constexpr (std::is_integral_v<T>) {
+        // long integers. parse them as integers to keep them exact.
+        int64 v{};
+        auto ret = std::from_chars(first, end, v);
+        if (ret.ptr != first && (ret.ptr == end || !is_float_part(*ret.ptr))) {
+            if (ret.ec != std::errc{} || !in_range<T>(v))
+                return nullptr;
+            dst = T(v);
+            return ret.ptr;
+        }
+    }
+#ifdef sfbxUseCharconv
+    using parse_t = std::conditional_t<std::is_floating_point_v<T>, T, float64>;
+    parse_t v{};
+    auto ret = std::from_chars(first, end, v);
+    if (ret.ptr == first)
+        return begin;
+    if (!in_range<T>(v))
+        return nullptr;
+    dst = T(v);
+    return ret.ptr;
+#else
+    // strtod() requires a null-terminated string
+    char buf[64];
+    size_t len = 0;
+    while (first + len < end && len < std::size(buf) - 1 && (is_float_part(first[len]) || first[len] == '-' || first[len] == '+'
+        || std::isalpha((unsigned char)first[len]))) // inf, nan
+        ++len;
+    memcpy(buf, first, len);
+    buf[len] = '\0';
+    char* e;
+    float64 v = std::strtod(buf, &e);
+    if (e == buf)
+        return begin;
+    if (!in_range<T>(v))
+        return nullptr;
+    dst = T(v);
+    return first + (e - buf);
+#endif
+}
+
+// single-pass tokenizer of ascii FBX. it works on the whole data in place and never copies nor rescans it.
+struct AsciiToken
+{
+    enum class Type
+    {
+        End,
+        NewLine,
+        Word,       // node names and bare values (e.g. "T" in "Shading: T")
+        Number,
+        String,     // text is without the quotes
+        ArraySize,  // "*N". text is with '*'
+        Colon,
+        Comma,
+        OpenBrace,
+        CloseBrace,
+    };
+    Type type = Type::End;
+    string_view text;
+};
+
+class AsciiTokenizer
+{
+public:
+    using Type = AsciiToken::Type;
+
+    explicit AsciiTokenizer(string_view data) : m_pos(data.data()), m_end(data.data() + data.size()) {}
+
+    // data after the last token
+    string_view getRemaining() const { return make_view(m_pos, m_end); }
+    const char* tell() const { return m_pos; }
+    void seek(const char* pos) { m_pos = pos; }
+
+    AsciiToken next()
+    {
+        const char* p = m_pos;
+        // skip spaces and comments. comments start with ';' and last until the end of the line.
+        for (;;) {
+            while (p < m_end && (*p == ' ' || *p == '\t' || *p == '\r'))
+                ++p;
+            if (p < m_end && *p == ';') {
+                p = find_char(p, m_end, '\n');
+                continue;
+            }
+            break;
+        }
+        if (p == m_end) {
+            m_pos = p;
+            return {};
+        }
+
+        const char* begin = p;
+        Type type;
+        switch (*p++) {
+        case '\n': type = Type::NewLine; break;
+        case ':': type = Type::Colon; break;
+        case ',': type = Type::Comma; break;
+        case '{': type = Type::OpenBrace; break;
+        case '}': type = Type::CloseBrace; break;
+        case '"':
+        {
+            p = find_char(p, m_end, '"');
+            AsciiToken ret{ Type::String, make_view(begin + 1, p) };
+            m_pos = p < m_end ? p + 1 : p;
+            return ret;
+        }
+        case '*':
+            type = Type::ArraySize;
+            while (p < m_end && std::isdigit((unsigned char)*p))
+                ++p;
+            break;
+        default:
+        {
+            char c = *begin;
+            type = std::isdigit((unsigned char)c) || c == '-' || c == '+' || c == '.' ? Type::Number : Type::Word;
+            while (p < m_end && !isDelimiter(*p))
+                ++p;
+            break;
+        }
+        }
+        m_pos = p;
+        return { type, make_view(begin, p) };
+    }
+
+    // read numbers of an array payload ("v0,v1,...") into dst. reading ends at '}' and it is consumed.
+    // returns the number of values in the payload. values that don't fit in dst are skipped.
+    template<class T>
+    size_t readArray(span<T> dst)
+    {
+        size_t n = 0;
+        T skipped;
+        const char* p = m_pos;
+        for (;;) {
+            while (p < m_end && (*p == ',' || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+                ++p;
+            if (p == m_end)
+                break;
+            if (*p == '}') {
+                ++p;
+                break;
+            }
+            if (*p == ';') {
+                p = find_char(p, m_end, '\n');
+                continue;
+            }
+
+            const char* e = parse_number(p, m_end, n < dst.size() ? dst[n] : skipped);
+            if (!e)
+                throw std::runtime_error("sfbx::ReadAsciiNode(): invalid array");
+            if (e != p) {
+                ++n;
+            }
+            else {
+                // not a number. ignore it.
+                do {
+                    ++e;
+                } while (e < m_end && !isDelimiter(*e));
+            }
+            p = e;
+        }
+        m_pos = p;
+        return n;
+    }
+
+    // skip the rest of a block whose '{' is already consumed. the closing '}' is consumed too.
+    void skipBlock()
+    {
+        m_pos = find_closing_brace(m_pos, m_end);
+    }
+
+private:
+    static bool isDelimiter(char c)
+    {
+        switch (c) {
+        case ' ': case '\t': case '\r': case '\n':
+        case ',': case ':': case '{': case '}': case '"': case ';':
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    const char* m_pos;
+    const char* m_end;
+};
+
 } // namespace sfbx
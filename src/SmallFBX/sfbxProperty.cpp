@@ -4,9 +4,6 @@
 #include "sfbxObject.h"
 #include "sfbxParser.h"
 
-#include <zlib.h>
-#pragma comment(lib, "zlib.lib")
-
 
 namespace sfbx {
 
@@ -44,15 +41,23 @@ Property::Property(Property&& v) noexcept
     : m_type(v.m_type)
     , m_scalar(v.m_scalar)
     , m_data(std::move(v.m_data))
+    , m_view(v.m_view)
+    , m_compressed_size(v.m_compressed_size)
+    , m_deferred(std::move(v.m_deferred))
 {}
 
-void Property::read(std::istream& is)
+static inline void Decompress(span<char> dst, string_view src)
+{
+    if (!Inflate(dst, src))
+        sfbxPrint("sfbx::Property: failed to decompress array\n");
+}
+
+void Property::read(string_view& is, bool lazy_decompression)
 {
     m_type = read1<PropertyType>(is);
     if (m_type == PropertyType::String || m_type == PropertyType::Blob) {
         uint32_t length = read1<uint32_t>(is);
-        m_data.resize(length);
-        is.read(m_data.data(), length);
+        m_view = make_span(readv(is, length));
     }
     else if (!isArray()) {
         switch (m_type) {
@@ -79,27 +84,52 @@ void Property::read(std::istream& is)
         uint32_t array_size = read1<uint32_t>(is);
         uint32_t encoding = read1<uint32_t>(is); // 0: plain 1: zlib-compressed
 
-        uLong src_size = read1<uint32_t>(is);
-        uLong dest_size = SizeOfElement(m_type) * array_size;
-        m_data.resize(dest_size);
+        uint32_t src_size = read1<uint32_t>(is);
+        uint64_t dest_size = (uint64_t)SizeOfElement(m_type) * array_size;
 
         if (encoding == 0) {
-            readv(is, m_data.data(), dest_size);
+            m_view = make_span(readv(is, dest_size));
+            // arrays are accessed via typed pointers. make own copy if the view of the source is misaligned.
+            if ((uintptr_t)m_view.data() % SizeOfElement(m_type) != 0)
+                detach();
         }
         else if (encoding == 1) {
-            RawVector<char> compressed(src_size);
-            readv(is, compressed.data(), src_size);
-            uncompress((Bytef*)m_data.data(), &dest_size, (const Bytef*)compressed.data(), src_size);
+            auto compressed = readv(is, src_size);
+            if (lazy_decompression && dest_size != 0) {
+                m_view = make_span(compressed);
+                m_compressed_size = dest_size;
+            }
+            else {
+                Decompress(allocate(dest_size), compressed);
+            }
+        }
+        else {
+            throw std::runtime_error(std::string("sfbx::Property::read(): Unsupported encoding ") + std::to_string(encoding));
         }
     }
 }
 
-void Property::write(std::ostream& os)
+void Property::write(std::ostream& os, const CompressionOptions& opt) const
+{
+    OutputBuffer buf(os);
+    write(buf, opt);
+}
+
+void Property::write(OutputBuffer& os, const CompressionOptions& opt) const
 {
+    RawVector<char> compressed;
+    write(os, opt, compressed);
+}
+
+void Property::write(OutputBuffer& os, const CompressionOptions& opt, RawVector<char>& compressed_buf) const
+{
+    // deferred arrays are not generated as a whole. see below.
+    if (isCompressed())
+        decompress();
     writev(os, m_type);
     if (m_type == PropertyType::Blob || m_type == PropertyType::String) {
-        writev(os, (uint32_t)m_data.size());
-        writev(os, m_data);
+        writev(os, (uint32_t)m_view.size());
+        writev(os, m_view);
     }
     else if (!isArray()) {
         // scalar
@@ -125,20 +155,11 @@ void Property::write(std::ostream& os)
     }
     else {
         // array
-        // use zlib if the data size is reasonably large.
-        bool use_zlib = m_data.size() >= 128;
-
-        if (use_zlib) {
+        auto compressed = getCompressed(opt, compressed_buf);
+        if (!compressed.empty()) {
             // with zlib compression
             writev(os, (uint32_t)getArraySize());
             writev(os, (uint32_t)1); // encoding: zlib
-
-            uLong src_size = m_data.size();
-            uLong dest_size = compressBound(src_size);
-            RawVector<char> compressed(dest_size);
-            compress((Bytef*)compressed.data(), &dest_size, (const Bytef*)m_data.data(), src_size);
-            compressed.resize(dest_size);
-
             writev(os, (uint32_t)compressed.size());
             writev(os, compressed);
         }
@@ -146,58 +167,280 @@ void Property::write(std::ostream& os)
             // without zlib compression
             writev(os, (uint32_t)getArraySize());
             writev(os, (uint32_t)0); // encoding: plain
-            writev(os, (uint32_t)m_data.size());
-            writev(os, m_data);
+            writev(os, (uint32_t)getPayloadSize());
+            if (m_deferred) {
+                RawVector<char> buf;
+                size_t pos = 0;
+                for (auto chunk = generateChunk(buf, pos); !chunk.empty(); chunk = generateChunk(buf, pos))
+                    writev(os, chunk);
+            }
+            else {
+                writev(os, m_view);
+            }
+        }
+    }
+}
+
+uint64_t Property::getBinarySize(const CompressionOptions& opt) const
+{
+    RawVector<char> compressed;
+    return getBinarySize(opt, compressed);
+}
+
+uint64_t Property::getBinarySize(const CompressionOptions& opt, RawVector<char>& compressed_buf) const
+{
+    if (isCompressed())
+        decompress();
+    uint64_t ret = 1; // type
+    if (m_type == PropertyType::Blob || m_type == PropertyType::String) {
+        ret += 4 + m_view.size();
+    }
+    else if (!isArray()) {
+        switch (m_type) {
+        case PropertyType::Bool: ret += 1; break;
+        case PropertyType::Int16: ret += 2; break;
+        case PropertyType::Int32:
+        case PropertyType::Float32: ret += 4; break;
+        case PropertyType::Int64:
+        case PropertyType::Float64: ret += 8; break;
+        default: break;
+        }
+    }
+    else {
+        // array size, encoding, payload size
+        ret += 12;
+        auto compressed = getCompressed(opt, compressed_buf);
+        ret += !compressed.empty() ? compressed.size() : getPayloadSize();
+    }
+    return ret;
+}
+
+int Property::getCompressionLevel(const CompressionOptions& opt) const
+{
+    if (!isArray() || opt.store_only)
+        return 0;
+
+    int level = opt.level;
+    size_t threshold = opt.threshold;
+    for (auto& o : opt.overrides) {
+        if (o.type == m_type) {
+            level = o.level;
+            threshold = o.threshold;
+            break;
+        }
+    }
+    if (getPayloadSize() < threshold)
+        return 0;
+    return level;
+}
+
+uint64_t Property::getPayloadHash() const
+{
+    if (isCompressed())
+        decompress();
+    if (m_deferred) {
+        RawVector<char> buf;
+        size_t pos = 0;
+        uint64_t hash = 0;
+        for (auto chunk = generateChunk(buf, pos); !chunk.empty(); chunk = generateChunk(buf, pos))
+            hash = Hash64(chunk.data(), chunk.size(), hash);
+        return hash;
+    }
+    return Hash64(m_view.data(), m_view.size());
+}
+
+void Property::getPayload(RawVector<char>& dst) const
+{
+    if (isCompressed())
+        decompress();
+    if (m_deferred) {
+        dst.resize(getPayloadSize());
+        size_t first = 0;
+        RawVector<char> buf;
+        size_t pos = 0;
+        for (auto chunk = generateChunk(buf, pos); !chunk.empty(); chunk = generateChunk(buf, pos)) {
+            memcpy(dst.data() + first, chunk.data(), chunk.size());
+            first += chunk.size();
         }
     }
+    else {
+        dst.assign(m_view.begin(), m_view.end());
+    }
 }
 
+bool Property::equalsPayload(string_view v) const
+{
+    if (isCompressed())
+        decompress();
+    if (v.size() != getPayloadSize())
+        return false;
+    if (m_deferred) {
+        size_t first = 0;
+        RawVector<char> buf;
+        size_t pos = 0;
+        for (auto chunk = generateChunk(buf, pos); !chunk.empty(); chunk = generateChunk(buf, pos)) {
+            if (memcmp(v.data() + first, chunk.data(), chunk.size()) != 0)
+                return false;
+            first += chunk.size();
+        }
+        return true;
+    }
+    return memcmp(v.data(), m_view.data(), v.size()) == 0;
+}
+
+string_view Property::getCompressed(const CompressionOptions& opt, RawVector<char>& dst) const
+{
+    int level = getCompressionLevel(opt);
+    if (level == 0)
+        return {};
+
+    size_t size = getPayloadSize();
+
+    if (dst.empty()) {
+        if (isCompressed())
+            decompress();
+        dst.resize(DeflateBound(size));
+        if (m_deferred) {
+            RawVector<char> buf;
+            size_t pos = 0;
+            dst.resize(Deflate(make_span(dst), [&]() { return generateChunk(buf, pos); }, level));
+        }
+        else {
+            dst.resize(Deflate(make_span(dst), make_view(m_view), level));
+        }
+        // may be kept for a while (until the node is written). release the unused space.
+        dst.shrink_to_fit();
+    }
+    if (opt.adaptive && dst.size() >= size)
+        return {};
+    return make_view(dst);
+}
+
+
+span<char> Property::allocate(size_t size)
+{
+    m_data.resize(size);
+    m_view = make_span(m_data);
+    m_compressed_size = 0;
+    m_deferred.reset();
+    return m_view;
+}
+
+void Property::setDeferred(size_t num_elements, size_t element_size, Generator&& gen)
+{
+    m_deferred.reset(new DeferredArray{ num_elements, element_size, std::move(gen) });
+}
+
+size_t Property::getPayloadSize() const
+{
+    if (m_deferred)
+        return m_deferred->num_elements * m_deferred->element_size;
+    // m_view is still compressed. the size after decompression is known without decompressing.
+    if (isCompressed())
+        return m_compressed_size;
+    return m_view.size();
+}
+
+string_view Property::generateChunk(RawVector<char>& buf, size_t& pos) const
+{
+    // large enough to keep deflate busy, small enough to stay in cache
+    const size_t chunk_size = 64 * 1024;
+
+    auto& d = *m_deferred;
+    size_t count = std::min(std::max(chunk_size / d.element_size, size_t(1)), d.num_elements - pos);
+    if (count == 0)
+        return {};
+    buf.resize(count * d.element_size);
+    d.generate(pos, count, buf.data());
+    pos += count;
+    return make_view(buf);
+}
+
+void Property::detach() const
+{
+    if (m_view.empty() || m_view.data() == m_data.data())
+        return;
+    m_data.assign(m_view.begin(), m_view.end());
+    m_view = make_span(m_data);
+}
+
+bool Property::isCompressed() const
+{
+    return m_compressed_size != 0;
+}
+
+bool Property::isDeferred() const
+{
+    return m_deferred != nullptr;
+}
+
+void Property::decompress() const
+{
+    if (m_deferred) {
+        auto d = std::move(m_deferred);
+        m_data.resize(d->num_elements * d->element_size);
+        m_view = make_span(m_data);
+        d->generate(0, d->num_elements, m_data.data());
+        return;
+    }
+
+    if (m_compressed_size == 0)
+        return;
+    // compressed data may be in m_data (detached). move it out before allocation.
+    RawVector<char> tmp;
+    if (m_view.data() == m_data.data())
+        tmp = std::move(m_data);
+    auto compressed = make_view(m_view);
+    m_data.resize(m_compressed_size);
+    m_view = make_span(m_data);
+    m_compressed_size = 0;
+    Decompress(m_view, compressed);
+}
 
 template<> span<int32> Property::allocateArray(size_t size)
 {
     m_type = PropertyType::Int32Array;
-    m_data.resize(size * sizeof(int32));
-    return make_span((int32*)m_data.data(), size);
+    return make_span((int32*)allocate(size * sizeof(int32)).data(), size);
+}
+
+template<> span<int64> Property::allocateArray(size_t size)
+{
+    m_type = PropertyType::Int64Array;
+    return make_span((int64*)allocate(size * sizeof(int64)).data(), size);
 }
 
 template<> span<float32> Property::allocateArray(size_t size)
 {
     m_type = PropertyType::Float32Array;
-    m_data.resize(size * sizeof(float32));
-    return make_span((float32*)m_data.data(), size);
+    return make_span((float32*)allocate(size * sizeof(float32)).data(), size);
 }
 
 template<> span<float64> Property::allocateArray(size_t size)
 {
     m_type = PropertyType::Float64Array;
-    m_data.resize(size * sizeof(float64));
-    return make_span((float64*)m_data.data(), size);
+    return make_span((float64*)allocate(size * sizeof(float64)).data(), size);
 }
 template<> span<double2> Property::allocateArray(size_t size)
 {
     m_type = PropertyType::Float64Array;
-    m_data.resize(size * sizeof(double2));
-    return make_span((double2*)m_data.data(), size);
+    return make_span((double2*)allocate(size * sizeof(double2)).data(), size);
 }
 template<> span<double3> Property::allocateArray(size_t size)
 {
     m_type = PropertyType::Float64Array;
-    m_data.resize(size * sizeof(double3));
-    return make_span((double3*)m_data.data(), size);
+    return make_span((double3*)allocate(size * sizeof(double3)).data(), size);
 }
 template<> span<double4> Property::allocateArray(size_t size)
 {
     m_type = PropertyType::Float64Array;
-    m_data.resize(size * sizeof(double4));
-    return make_span((double4*)m_data.data(), size);
+    return make_span((double4*)allocate(size * sizeof(double4)).data(), size);
 }
 
+
 template<class T>
-static inline void Assign(RawVector<char>& dst, const span<T>& v)
+static inline void Assign(span<char> dst, span<T> src)
 {
-    size_t s = v.size_bytes();
-    dst.resize(s);
-    dst.assign((char*)v.data(), s);
+    memcpy(dst.data(), src.data(), src.size_bytes());
 }
 
 template<> void Property::assign(boolean v) { m_type = PropertyType::Bool; m_scalar.b = v; }
@@ -208,18 +451,18 @@ template<> void Property::assign(int64 v)   { m_type = PropertyType::Int64; m_sc
 template<> void Property::assign(float32 v) { m_type = PropertyType::Float32; m_scalar.f32 = v; }
 template<> void Property::assign(float64 v) { m_type = PropertyType::Float64; m_scalar.f64 = v; }
 
-template<> void Property::assign(double2 v)     { m_type = PropertyType::Float64Array; Assign(m_data, make_span(v)); }
-template<> void Property::assign(double3 v)     { m_type = PropertyType::Float64Array; Assign(m_data, make_span(v)); }
-template<> void Property::assign(double4 v)     { m_type = PropertyType::Float64Array; Assign(m_data, make_span(v)); }
-template<> void Property::assign(double4x4 v)   { m_type = PropertyType::Float64Array; Assign(m_data, make_span(v)); }
+template<> void Property::assign(double2 v)     { m_type = PropertyType::Float64Array; Assign(allocate(sizeof(v)), make_span(v)); }
+template<> void Property::assign(double3 v)     { m_type = PropertyType::Float64Array; Assign(allocate(sizeof(v)), make_span(v)); }
+template<> void Property::assign(double4 v)     { m_type = PropertyType::Float64Array; Assign(allocate(sizeof(v)), make_span(v)); }
+template<> void Property::assign(double4x4 v)   { m_type = PropertyType::Float64Array; Assign(allocate(sizeof(v)), make_span(v)); }
 
-template<> void Property::assign(span<uint8_t> v) { m_type = PropertyType::Blob; Assign(m_data, v); }
-template<> void Property::assign(span<boolean> v) { m_type = PropertyType::BoolArray; Assign(m_data, v); }
-template<> void Property::assign(span<int16> v)   { m_type = PropertyType::Int16Array; Assign(m_data, v); }
-template<> void Property::assign(span<int32> v)   { m_type = PropertyType::Int32Array; Assign(m_data, v); }
-template<> void Property::assign(span<int64> v)   { m_type = PropertyType::Int64Array; Assign(m_data, v); }
-template<> void Property::assign(span<float32> v) { m_type = PropertyType::Float32Array; Assign(m_data, v); }
-template<> void Property::assign(span<float64> v) { m_type = PropertyType::Float64Array; Assign(m_data, v); }
+template<> void Property::assign(span<uint8_t> v) { m_type = PropertyType::Blob; Assign(allocate(v.size_bytes()), v); }
+template<> void Property::assign(span<boolean> v) { m_type = PropertyType::BoolArray; Assign(allocate(v.size_bytes()), v); }
+template<> void Property::assign(span<int16> v)   { m_type = PropertyType::Int16Array; Assign(allocate(v.size_bytes()), v); }
+template<> void Property::assign(span<int32> v)   { m_type = PropertyType::Int32Array; Assign(allocate(v.size_bytes()), v); }
+template<> void Property::assign(span<int64> v)   { m_type = PropertyType::Int64Array; Assign(allocate(v.size_bytes()), v); }
+template<> void Property::assign(span<float32> v) { m_type = PropertyType::Float32Array; Assign(allocate(v.size_bytes()), v); }
+template<> void Property::assign(span<float64> v) { m_type = PropertyType::Float64Array; Assign(allocate(v.size_bytes()), v); }
 
 template<> void Property::assign(span<float2> v)  { assign(span<float32>{ (float32*)v.data(), v.size() * 2 }); }
 template<> void Property::assign(span<float3> v)  { assign(span<float32>{ (float32*)v.data(), v.size() * 3 }); }
@@ -232,6 +475,9 @@ void Property::assign(string_view v)
 {
     m_type = PropertyType::String;
     m_data.assign(v.begin(), v.end());
+    m_view = make_span(m_data);
+    m_compressed_size = 0;
+    m_deferred.reset();
 }
 
 PropertyType Property::getType() const
@@ -246,7 +492,8 @@ bool Property::isArray() const
 
 uint64_t Property::getArraySize() const
 {
-    return m_data.size() / SizeOfElement(m_type);
+    // element count is known without decompression
+    return getPayloadSize() / SizeOfElement(m_type);
 }
 
 template<> boolean Property::getValue() const { convert(PropertyType::Bool); return m_scalar.b; }
@@ -257,24 +504,24 @@ template<> int64   Property::getValue() const { convert(PropertyType::Int64); re
 template<> float32 Property::getValue() const { convert(PropertyType::Float32); return m_scalar.f32; }
 template<> float64 Property::getValue() const { return m_scalar.f64; }
 
-template<> double2 Property::getValue() const { return *(double2*)m_data.data(); }
-template<> double3 Property::getValue() const { return *(double3*)m_data.data(); }
-template<> double4 Property::getValue() const { return *(double4*)m_data.data(); }
-template<> double4x4 Property::getValue() const { return *(double4x4*)m_data.data(); }
+template<> double2 Property::getValue() const { decompress(); return *(double2*)m_view.data(); }
+template<> double3 Property::getValue() const { decompress(); return *(double3*)m_view.data(); }
+template<> double4 Property::getValue() const { decompress(); return *(double4*)m_view.data(); }
+template<> double4x4 Property::getValue() const { decompress(); return *(double4x4*)m_view.data(); }
 
 template<> string_view Property::getValue() const { return getString(); }
 
-template<> span<int16>   Property::getArray() const { convert(PropertyType::Int16Array); return make_span((int16*)m_data.data(), getArraySize()); }
-template<> span<int32>   Property::getArray() const { convert(PropertyType::Int32Array); return make_span((int32*)m_data.data(), getArraySize()); }
-template<> span<int64>   Property::getArray() const { convert(PropertyType::Int64Array); return make_span((int64*)m_data.data(), getArraySize()); }
-template<> span<float32> Property::getArray() const { convert(PropertyType::Float32Array); return make_span((float32*)m_data.data(), getArraySize()); }
-template<> span<float64> Property::getArray() const { return make_span((float64*)m_data.data(), getArraySize()); }
+template<> span<int16>   Property::getArray() const { decompress(); convert(PropertyType::Int16Array); return make_span((int16*)m_view.data(), getArraySize()); }
+template<> span<int32>   Property::getArray() const { decompress(); convert(PropertyType::Int32Array); return make_span((int32*)m_view.data(), getArraySize()); }
+template<> span<int64>   Property::getArray() const { decompress(); convert(PropertyType::Int64Array); return make_span((int64*)m_view.data(), getArraySize()); }
+template<> span<float32> Property::getArray() const { decompress(); convert(PropertyType::Float32Array); return make_span((float32*)m_view.data(), getArraySize()); }
+template<> span<float64> Property::getArray() const { decompress(); return make_span((float64*)m_view.data(), getArraySize()); }
 
-template<> span<double2> Property::getArray() const { return make_span((double2*)m_data.data(), getArraySize() / 2); }
-template<> span<double3> Property::getArray() const { return make_span((double3*)m_data.data(), getArraySize() / 3); }
-template<> span<double4> Property::getArray() const { return make_span((double4*)m_data.data(), getArraySize() / 4); }
+template<> span<double2> Property::getArray() const { decompress(); return make_span((double2*)m_view.data(), getArraySize() / 2); }
+template<> span<double3> Property::getArray() const { decompress(); return make_span((double3*)m_view.data(), getArraySize() / 3); }
+template<> span<double4> Property::getArray() const { decompress(); return make_span((double4*)m_view.data(), getArraySize() / 4); }
 
-string_view Property::getString() const { return make_view(m_data); }
+string_view Property::getString() const { return make_view(m_view); }
 
 template<class T>
 static inline void Convert(RawVector<char>& data)
@@ -302,6 +549,10 @@ bool Property::convert(PropertyType t) const
         }
     }
     else if (m_type == PropertyType::Float64Array) {
+        decompress();
+        // conversion is done in place. make own copy if the payload is external memory.
+        detach();
+
         switch (t) {
         case PropertyType::Int16Array: Convert<int16>(m_data); ret = true; break;
         case PropertyType::Int32Array: Convert<int32>(m_data); ret = true; break;
@@ -309,6 +560,7 @@ bool Property::convert(PropertyType t) const
         case PropertyType::Float32Array: Convert<float32>(m_data); ret = true; break;
         default: break;
         }
+        m_view = make_span(m_data);
     }
 
     if (ret) {
@@ -356,7 +608,7 @@ void Property::toString(std::string& dst, int depth) const
         case PropertyType::Blob:
         {
             dst += '"';
-            dst += Base64Encode(make_span(m_data));
+            dst += Base64Encode(m_view);
             dst += '"';
             break;
         }
@@ -364,7 +616,7 @@ void Property::toString(std::string& dst, int depth) const
         {
             std::string s;
             s += " "; // just reserve space to avoid escape
-            if (!m_data.empty()) {
+            if (!m_view.empty()) {
                 auto get_span = [](const char* s, size_t n) {
                     size_t i = 0;
                     for (; s[i] != '\0' && i < n; ++i) {}
@@ -372,13 +624,13 @@ void Property::toString(std::string& dst, int depth) const
                 };
 
                 string_view obj_name, class_name;
-                if (SplitFullName(make_view(m_data), obj_name, class_name)) {
+                if (SplitFullName(make_view(m_view), obj_name, class_name)) {
                     s.insert(s.end(), class_name.begin(), class_name.end());
                     s += "::";
                     s.insert(s.end(), obj_name.begin(), obj_name.end());
                 }
                 else {
-                    s.insert(s.end(), m_data.begin(), m_data.end());
+                    s.insert(s.end(), m_view.begin(), m_view.end());
                 }
                 Escape(s);
             }
@@ -6,6 +6,8 @@
 
 namespace sfbx {
 
+class OutputBuffer;
+
 enum class PropertyType : uint8_t
 {
     Unknown,
@@ -29,6 +31,28 @@ enum class PropertyType : uint8_t
 };
 uint32_t SizeOfElement(PropertyType type);
 
+// how array properties are compressed in binary FBX. (see WriteOptions)
+struct CompressionOptions
+{
+    struct TypeOverride
+    {
+        PropertyType type;
+        int level;
+        size_t threshold;
+    };
+
+    // zlib compression level. 1 (fastest) - 9 (smallest), -1 is zlib's default. 0 stores arrays without compression.
+    int level = -1;
+    // arrays smaller than this (in bytes) are stored without compression.
+    size_t threshold = 128;
+    // level and threshold for specific types. e.g. { PropertyType::Float64Array, 1, 1024 }
+    std::vector<TypeOverride> overrides;
+    // store all arrays without compression regardless of other settings. fastest, but the file gets large.
+    bool store_only = false;
+    // store arrays without compression if compression doesn't make them smaller. (e.g. high-entropy float arrays)
+    bool adaptive = false;
+};
+
 
 template<class T> inline constexpr bool is_propery_pod = false;
 #define PropPOD(T) template<> inline constexpr bool is_propery_pod<T> = true;
@@ -55,8 +79,17 @@ public:
     Property(const Property&) = delete;
     Property& operator=(const Property&) = delete;
 
-    void read(std::istream& is);
-    void write(std::ostream& os);
+    // is must outlive this property. uncompressed arrays and strings refer it directly instead of holding copies.
+    // if lazy_decompression is true, compressed arrays also refer it and are inflated on first access.
+    void read(string_view& is, bool lazy_decompression = false);
+    void write(std::ostream& os, const CompressionOptions& opt = {}) const;
+    void write(OutputBuffer& os, const CompressionOptions& opt = {}) const;
+    // size of the data write() emits.
+    uint64_t getBinarySize(const CompressionOptions& opt = {}) const;
+    // compressed: the compressed payload of the array. it is made if empty and used as is otherwise,
+    // so getBinarySize() and write() with the same buffer compress the array only once.
+    void write(OutputBuffer& os, const CompressionOptions& opt, RawVector<char>& compressed) const;
+    uint64_t getBinarySize(const CompressionOptions& opt, RawVector<char>& compressed) const;
 
     template<class T> span<T> allocateArray(size_t size);
 
@@ -65,6 +98,9 @@ public:
     template<class T> void assign(const RawVector<T>& v) { assign(make_span(v)); }
     template<class D, class S> void assign(array_adaptor<D, S> v) { copy(allocateArray<D>(v.values.size()), v.values); }
     void assign(string_view v);
+    // refer v.values instead of copying. elements are converted when the payload is needed, chunk by chunk if it is written.
+    // v.values must be kept alive and unchanged until then. (see ExportOptions::refer_object_data)
+    template<class D, class S> void assignDeferred(array_adaptor<D, S> v);
 
 
     PropertyType getType() const;
@@ -75,10 +111,46 @@ public:
     template<class T> span<T> getArray() const;
     string_view getString() const;
 
+    // true if the payload is still zlib-compressed. (see LoadOptions::lazy_decompression)
+    bool isCompressed() const;
+    // true if the payload is not generated yet. (see assignDeferred())
+    bool isDeferred() const;
+    // inflate the payload if it is still compressed, or generate it if deferred. accessors call this implicitly.
+    void decompress() const;
+
+    // make own copy of the payload if it refers external memory. (see read())
+    void detach() const;
+
     bool convert(PropertyType t) const;
     void toString(std::string& dst, int depth = 0) const;
 
+    // internal. used to reuse compressed payloads across writes. (see WriteOptions::reuse_compressed_arrays)
+    // 0 if the array is stored without compression.
+    int getCompressionLevel(const CompressionOptions& opt) const;
+    uint64_t getPayloadHash() const;
+    // copy of the uncompressed payload / true if the uncompressed payload is the same as v.
+    void getPayload(RawVector<char>& dst) const;
+    bool equalsPayload(string_view v) const;
+    // compress the array into dst unless dst already has it. returns empty if the array should be stored without compression.
+    string_view getCompressed(const CompressionOptions& opt, RawVector<char>& dst) const;
+
 private:
+    // fill dst with elements [first, first + count) of the array
+    using Generator = std::function<void(size_t first, size_t count, void* dst)>;
+    struct DeferredArray
+    {
+        size_t num_elements;
+        size_t element_size;
+        Generator generate;
+    };
+
+    span<char> allocate(size_t size);
+    void setDeferred(size_t num_elements, size_t element_size, Generator&& gen);
+    // size of the uncompressed payload, even if it is still compressed or not generated yet.
+    size_t getPayloadSize() const;
+    // generate the next part of the deferred payload into buf. pos is in elements. returns empty when done.
+    string_view generateChunk(RawVector<char>& buf, size_t& pos) const;
+
     mutable PropertyType m_type{};
     union {
         boolean b;
@@ -89,6 +161,19 @@ private:
         float64 f64;
     } mutable m_scalar{};
     mutable RawVector<char> m_data;
+    mutable span<char> m_view; // payload of array / string / blob. refers m_data or external memory (e.g. memory-mapped file)
+    mutable uint64_t m_compressed_size{}; // non-zero if m_view is still zlib-compressed. this holds the size after decompression
+    mutable std::unique_ptr<DeferredArray> m_deferred; // non-null if the payload is generated on demand
 };
 
+template<class D, class S>
+inline void Property::assignDeferred(array_adaptor<D, S> v)
+{
+    allocateArray<D>(0); // set the type
+    auto values = v.values;
+    setDeferred(values.size(), sizeof(D), [values](size_t first, size_t count, void* dst) {
+        copy((D*)dst, values.data() + first, count);
+    });
+}
+
 } // namespace sfbx
@@ -25,7 +25,7 @@ public:
     RawVector(const RawVector& v) { assign(v.begin(), v.end()); }
     RawVector(std::initializer_list<T> v) { assign(v); }
     RawVector(const_iterator b, const_iterator e) { assign(b, e); }
-    template<class U> RawVector(span<U> v) { assign(v); }
+    template<class U> explicit RawVector(span<U> v) { assign(v); }
     template<class U, size_t N> RawVector(U(&v)[N]) { assign(v); }
     explicit RawVector(size_t initial_size) { resize(initial_size); }
 
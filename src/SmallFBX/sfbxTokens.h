@@ -192,6 +192,8 @@
 #define sfbxS_ColorIndex                "ColorIndex"
 #define sfbxS_Materials                 "Materials"
 #define sfbxS_PolygonVertexIndex        "PolygonVertexIndex"
+#define sfbxS_Edges                     "Edges"
+#define sfbxS_Smoothing                 "Smoothing"
 #define sfbxS_LayerElementNormal        "LayerElementNormal"
 #define sfbxS_LayerElementUV            "LayerElementUV"
 #define sfbxS_LayerElementColor         "LayerElementColor"
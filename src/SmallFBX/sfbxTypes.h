@@ -367,6 +367,7 @@ inline auto make_adaptor(const S& src, T&&... a) { return array_adaptor<D, get_v
 class Node; using NodePtr = std::shared_ptr<Node>;
 class Object; using ObjectPtr = std::shared_ptr<Object>;
 class Document; using DocumentPtr = std::shared_ptr<Document>;
+class NodeVisitor;
 
 template<class T, class U>
 inline T* as(U* v) { return dynamic_cast<T*>(v); }
@@ -4,6 +4,36 @@
 #include "sfbxGeometry.h"
 #include "sfbxDeformer.h"
 #include "sfbxUtil.h"
+#include "sfbxParser.h"
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <errno.h>
+#endif
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define sfbxSSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define sfbxNEON
+#endif
+#ifdef sfbxEnableMultithreading
+    #include <thread>
+    #include <atomic>
+    #include <mutex>
+    #include <condition_variable>
+    #include <deque>
+#endif
 
 namespace sfbx {
 
@@ -144,35 +174,558 @@ bool DeformVectors(span<float3> dst, const JointWeights& jw, const JointMatrices
 
 
 
-char CounterStream::StreamBuf::s_dummy_buf[1024];
+void ConvertFloatToDouble(float64* dst, const float32* src, size_t n)
+{
+    size_t i = 0;
+#if defined(sfbxSSE2)
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(src + i);
+        _mm_storeu_pd(dst + i, _mm_cvtps_pd(v));
+        _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+#elif defined(sfbxNEON)
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vld1q_f32(src + i);
+        vst1q_f64(dst + i, vcvt_f64_f32(vget_low_f32(v)));
+        vst1q_f64(dst + i + 2, vcvt_high_f64_f32(v));
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = src[i];
+}
 
-CounterStream::StreamBuf::StreamBuf()
+// x must not be 0
+static inline int CountTrailingZeros(uint64_t x)
 {
-    this->setp(s_dummy_buf, s_dummy_buf + std::size(s_dummy_buf));
+#ifdef _MSC_VER
+    unsigned long r;
+    #ifdef _WIN64
+        _BitScanForward64(&r, x);
+    #else
+        if (!_BitScanForward(&r, uint32_t(x))) {
+            _BitScanForward(&r, uint32_t(x >> 32));
+            r += 32;
+        }
+    #endif
+    return int(r);
+#else
+    return __builtin_ctzll(x);
+#endif
 }
 
-int CounterStream::StreamBuf::overflow(int c)
+const char* find_first_of(const char* begin, const char* end, string_view chars)
 {
-    m_size += uint64_t(this->pptr() - this->pbase()) + 1;
-    this->setp(s_dummy_buf, s_dummy_buf + std::size(s_dummy_buf));
-    return c;
+    if (chars.empty() || chars.size() > 4)
+        throw std::runtime_error("sfbx::find_first_of(): chars must be 1 to 4 characters");
+
+    // pad with the last character
+    char c[4];
+    for (size_t i = 0; i < 4; ++i)
+        c[i] = chars[std::min(i, chars.size() - 1)];
+
+    const char* p = begin;
+#if defined(sfbxSSE2)
+    __m128i c0 = _mm_set1_epi8(c[0]), c1 = _mm_set1_epi8(c[1]), c2 = _mm_set1_epi8(c[2]), c3 = _mm_set1_epi8(c[3]);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, c2), _mm_cmpeq_epi8(v, c3)));
+        if (int mask = _mm_movemask_epi8(hit))
+            return p + CountTrailingZeros(uint32_t(mask));
+    }
+#elif defined(sfbxNEON)
+    uint8x16_t c0 = vdupq_n_u8(c[0]), c1 = vdupq_n_u8(c[1]), c2 = vdupq_n_u8(c[2]), c3 = vdupq_n_u8(c[3]);
+    for (; end - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)p);
+        uint8x16_t hit = vorrq_u8(
+            vorrq_u8(vceqq_u8(v, c0), vceqq_u8(v, c1)),
+            vorrq_u8(vceqq_u8(v, c2), vceqq_u8(v, c3)));
+        // narrow to 4 bits per byte. NEON has no movemask.
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+        if (mask)
+            return p + CountTrailingZeros(mask) / 4;
+    }
+#endif
+    for (; p < end; ++p) {
+        char v = *p;
+        if (v == c[0] || v == c[1] || v == c[2] || v == c[3])
+            return p;
+    }
+    return end;
 }
 
-int CounterStream::StreamBuf::sync()
+
+uint64_t Hash64(const void* data, size_t size, uint64_t seed)
 {
-    m_size += uint64_t(this->pptr() - this->pbase());
-    this->setp(s_dummy_buf, s_dummy_buf + std::size(s_dummy_buf));
-    return 0;
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+
+    uint64_t h = seed ^ (size * m);
+    auto* p = (const uint8_t*)data;
+    auto* end = p + (size & ~size_t(7));
+    for (; p != end; p += 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    switch (size & 7) {
+    case 7: h ^= uint64_t(p[6]) << 48; [[fallthrough]];
+    case 6: h ^= uint64_t(p[5]) << 40; [[fallthrough]];
+    case 5: h ^= uint64_t(p[4]) << 32; [[fallthrough]];
+    case 4: h ^= uint64_t(p[3]) << 24; [[fallthrough]];
+    case 3: h ^= uint64_t(p[2]) << 16; [[fallthrough]];
+    case 2: h ^= uint64_t(p[1]) << 8; [[fallthrough]];
+    case 1: h ^= uint64_t(p[0]);
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
 }
 
-void CounterStream::StreamBuf::reset()
+bool ReadAll(std::istream& is, RawVector<char>& dst)
 {
+    dst.clear();
+
+    auto pos = is.tellg();
+    if (pos != std::streampos(-1)) {
+        // seekable. get the size and read at once.
+        is.seekg(0, std::ios::end);
+        auto end = is.tellg();
+        is.seekg(pos);
+        if (end != std::streampos(-1) && end >= pos) {
+            dst.resize(size_t(end - pos));
+            is.read(dst.data(), dst.size());
+            dst.resize(size_t(is.gcount()));
+            return !is.bad();
+        }
+    }
+
+    // non-seekable stream (e.g. pipe). read chunk by chunk.
+    const size_t chunk_size = 1024 * 1024;
+    for (;;) {
+        size_t size = dst.size();
+        dst.resize(size + chunk_size);
+        is.read(dst.data() + size, chunk_size);
+        dst.resize(size + size_t(is.gcount()));
+        if (!is)
+            break;
+    }
+    return !is.bad();
+}
+
+#ifdef sfbxEnableMultithreading
+// persistent worker threads shared by all ParallelFor() calls. created on first use.
+class WorkerPool
+{
+public:
+    static WorkerPool& getInstance()
+    {
+        static WorkerPool s_instance;
+        return s_instance;
+    }
+
+    size_t getNumWorkers() const
+    {
+        return m_threads.size();
+    }
+
+    void enqueue(std::function<void()>&& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_cond.notify_one();
+    }
+
+private:
+    WorkerPool()
+    {
+        // the thread calling ParallelFor() also works. so one less than the number of cores.
+        size_t num_workers = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+        m_threads.reserve(num_workers);
+        for (size_t i = 0; i < num_workers; ++i)
+            m_threads.emplace_back([this]() { process(); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for (auto& t : m_threads)
+            t.join();
+    }
+
+    void process()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+                if (m_jobs.empty())
+                    break; // stopped
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stop = false;
+};
+#endif
+
+void ParallelFor(size_t n, const std::function<void(size_t)>& body)
+{
+#ifdef sfbxEnableMultithreading
+    auto& pool = WorkerPool::getInstance();
+    size_t num_jobs = n > 1 ? std::min(pool.getNumWorkers(), n - 1) : 0;
+    if (num_jobs > 0) {
+        // shared with the jobs. jobs that start after all indices are done just return, so they may outlive this call.
+        struct State
+        {
+            const std::function<void(size_t)>* body;
+            size_t n;
+            std::atomic<size_t> index{ 0 };
+            std::atomic<size_t> done{ 0 };
+            std::atomic<bool> canceled{ false };
+            std::exception_ptr exception;
+            std::mutex mutex;
+            std::condition_variable cond;
+        };
+        auto state = std::make_shared<State>();
+        state->body = &body;
+        state->n = n;
+
+        auto run = [](State& s) {
+            for (;;) {
+                size_t i = s.index++;
+                if (i >= s.n)
+                    break;
+                if (!s.canceled) {
+                    try {
+                        (*s.body)(i);
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lock(s.mutex);
+                        if (!s.exception)
+                            s.exception = std::current_exception();
+                        s.canceled = true; // skip the remaining indices
+                    }
+                }
+                if (++s.done == s.n) {
+                    std::lock_guard<std::mutex> lock(s.mutex);
+                    s.cond.notify_all();
+                }
+            }
+        };
+
+        // the calling thread also works, and waits for all indices instead of the jobs.
+        // so nested calls from workers (all other workers may be busy) don't deadlock.
+        for (size_t ji = 0; ji < num_jobs; ++ji)
+            pool.enqueue([state, run]() { run(*state); });
+        run(*state);
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->cond.wait(lock, [&]() { return state->done == n; });
+        }
+
+        if (state->exception)
+            std::rethrow_exception(state->exception);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; ++i)
+        body(i);
+}
+
+
+MemoryMappedFile::MemoryMappedFile()
+{
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+    close();
+}
+
+bool MemoryMappedFile::open(const char* path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        ::CloseHandle(file);
+        return false;
+    }
+
+    // copy-on-write. arrays are handed out as mutable spans and writes to them must not reach the file.
+    HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (!mapping) {
+        ::CloseHandle(file);
+        return false;
+    }
+
+    void* data = ::MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (!data) {
+        ::CloseHandle(mapping);
+        ::CloseHandle(file);
+        return false;
+    }
+
+    m_file = file;
+    m_mapping = mapping;
+    m_data = (const char*)data;
+    m_size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // copy-on-write. see above.
+    void* data = ::mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file referenced
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = (const char*)data;
+    m_size = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+void MemoryMappedFile::close()
+{
+    if (!m_data)
+        return;
+
+#ifdef _WIN32
+    ::UnmapViewOfFile(m_data);
+    ::CloseHandle(m_mapping);
+    ::CloseHandle(m_file);
+    m_file = m_mapping = nullptr;
+#else
+    ::munmap((void*)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool MemoryMappedFile::valid() const { return m_data != nullptr; }
+string_view MemoryMappedFile::getData() const { return make_view(m_data, m_size); }
+
+
+OutputBuffer::OutputBuffer()
+    : m_buffer(default_capacity)
+{
+}
+
+OutputBuffer::OutputBuffer(std::ostream& os)
+    : m_buffer(default_capacity)
+    , m_os(&os)
+{
+    auto pos = os.tellp();
+    m_seekable = pos != std::streampos(-1);
+    if (m_seekable)
+        m_origin = std::streamoff(pos);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    close();
+}
+
+bool OutputBuffer::open(const char* path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = ::CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    m_file = file;
+    m_seekable = ::GetFileType(file) == FILE_TYPE_DISK;
+#else
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return false;
+    m_fd = fd;
+    m_seekable = ::lseek(fd, 0, SEEK_CUR) != -1;
+#endif
     m_size = 0;
-    this->setp(s_dummy_buf, s_dummy_buf + std::size(s_dummy_buf));
+    m_flushed = 0;
+    m_failed = false;
+    return true;
+}
+
+void OutputBuffer::close()
+{
+    flush();
+#ifdef _WIN32
+    if (m_file) {
+        ::CloseHandle(m_file);
+        m_file = nullptr;
+    }
+#else
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+void OutputBuffer::fill(char c, size_t size)
+{
+    while (size > 0) {
+        if (m_size == m_buffer.size())
+            flushBuffer();
+        size_t n = std::min(size, m_buffer.size() - m_size);
+        memset(m_buffer.data() + m_size, c, n);
+        m_size += n;
+        size -= n;
+    }
+}
+
+void OutputBuffer::patch(uint64_t pos, const void* data, size_t size)
+{
+    auto src = (const char*)data;
+    if (pos < m_flushed) {
+        // the part already passed to the sink
+        size_t n = (size_t)std::min<uint64_t>(size, m_flushed - pos);
+        if (!m_seekable || !patchSink(pos, src, n))
+            m_failed = true;
+        pos += n;
+        src += n;
+        size -= n;
+    }
+    if (size > 0)
+        memcpy(m_buffer.data() + (pos - m_flushed), src, size);
+}
+
+uint64_t OutputBuffer::tell() const
+{
+    return m_flushed + m_size;
+}
+
+bool OutputBuffer::isSeekable() const
+{
+    return m_seekable;
+}
+
+bool OutputBuffer::flush()
+{
+    flushBuffer();
+    if (m_os)
+        m_os->flush();
+    return !m_failed;
+}
+
+void OutputBuffer::flushBuffer()
+{
+    if (m_size > 0) {
+        if (!writeToSink(m_buffer.data(), m_size))
+            m_failed = true;
+        m_flushed += m_size;
+        m_size = 0;
+    }
 }
 
-CounterStream::CounterStream() : std::ostream(&m_buf) {}
-uint64_t CounterStream::size() { m_buf.sync(); return m_buf.m_size; }
-void CounterStream::reset() { m_buf.reset(); }
+void OutputBuffer::writeSlow(const void* data, size_t size)
+{
+    flushBuffer();
+    if (size >= m_buffer.size()) {
+        // large data (e.g. arrays) is passed to the sink directly
+        if (!writeToSink(data, size))
+            m_failed = true;
+        m_flushed += size;
+    }
+    else {
+        memcpy(m_buffer.data(), data, size);
+        m_size = size;
+    }
+}
+
+bool OutputBuffer::writeToSink(const void* data, size_t size)
+{
+    if (m_os) {
+        m_os->write((const char*)data, size);
+        return !m_os->fail();
+    }
+#ifdef _WIN32
+    auto src = (const char*)data;
+    while (size > 0) {
+        DWORD written = 0;
+        DWORD n = (DWORD)std::min<size_t>(size, 0x40000000);
+        if (!m_file || !::WriteFile(m_file, src, n, &written, nullptr))
+            return false;
+        src += written;
+        size -= written;
+    }
+    return true;
+#else
+    auto src = (const char*)data;
+    while (size > 0) {
+        ssize_t written = ::write(m_fd, src, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        src += written;
+        size -= (size_t)written;
+    }
+    return true;
+#endif
+}
+
+bool OutputBuffer::patchSink(uint64_t pos, const void* data, size_t size)
+{
+    if (m_os) {
+        m_os->seekp(m_origin + std::streamoff(pos));
+        m_os->write((const char*)data, size);
+        m_os->seekp(m_origin + std::streamoff(m_flushed));
+        return !m_os->fail();
+    }
+#ifdef _WIN32
+    LARGE_INTEGER p, end;
+    p.QuadPart = (LONGLONG)pos;
+    end.QuadPart = (LONGLONG)m_flushed;
+    DWORD written = 0;
+    bool ret = m_file &&
+        ::SetFilePointerEx(m_file, p, nullptr, FILE_BEGIN) &&
+        ::WriteFile(m_file, data, (DWORD)size, &written, nullptr) && written == size;
+    if (m_file)
+        ::SetFilePointerEx(m_file, end, nullptr, FILE_BEGIN);
+    return ret;
+#else
+    return m_fd != -1 && ::pwrite(m_fd, data, size, (off_t)pos) == (ssize_t)size;
+#endif
+}
 
 } // namespace sfbx
@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "Test.h"
 #include "SmallFBX.h"
+#include "SmallFBX/sfbxParser.h"
 
 using sfbx::as;
 using sfbx::span;
@@ -269,6 +270,1140 @@ testCase(fbxRead)
 
 }
 
+testCase(fbxReadMapped)
+{
+    // depends on fbxWrite's output
+    sfbx::LoadOptions opt;
+    opt.memory_mapped = true;
+    sfbx::DocumentPtr mapped = sfbx::MakeDocument("test_base_bin.fbx", opt);
+    sfbx::DocumentPtr streamed = sfbx::MakeDocument("test_base_bin.fbx");
+    testExpect(mapped->valid() && streamed->valid());
+    testExpect(mapped->getAllObjects().size() == streamed->getAllObjects().size());
+
+    auto get_mesh = [](sfbx::Document* doc) {
+        for (auto& obj : doc->getAllObjects())
+            if (auto mesh = as<sfbx::GeomMesh>(obj.get()))
+                return mesh;
+        return (sfbx::GeomMesh*)nullptr;
+    };
+    auto m1 = get_mesh(mapped.get());
+    auto m2 = get_mesh(streamed.get());
+    testExpect(m1 && m2);
+    testExpect(m1->getPoints().size() == m2->getPoints().size());
+    testExpect(std::equal(m1->getPoints().begin(), m1->getPoints().end(), m2->getPoints().begin()));
+    testExpect(std::equal(m1->getIndices().begin(), m1->getIndices().end(), m2->getIndices().begin()));
+
+    // arrays are writable. (pages are copy-on-write) the file must be unchanged.
+    auto find_raw_array = [](sfbx::Document* doc) -> sfbx::Property* {
+        for (auto& node : doc->getAllNodes())
+            for (auto& prop : node->getProperties())
+                if (prop.getType() == sfbx::PropertyType::Float64Array && !prop.isCompressed() && prop.getArraySize() > 0)
+                    return &prop;
+        return nullptr;
+    };
+    sfbx::Property* prop = find_raw_array(mapped.get());
+    testExpect(prop);
+    double original = prop->getArray<sfbx::float64>()[0];
+    prop->getArray<sfbx::float64>()[0] = original + 1.0;
+    testExpect(prop->getArray<sfbx::float64>()[0] == original + 1.0);
+
+    sfbx::DocumentPtr mapped2 = sfbx::MakeDocument("test_base_bin.fbx", opt);
+    sfbx::Property* prop2 = find_raw_array(mapped2.get());
+    testExpect(prop2 && prop2->getArray<sfbx::float64>()[0] == original);
+
+    // arrays that refer the mapped file are aligned for typed access
+    for (auto& node : mapped2->getAllNodes()) {
+        for (auto& p : node->getProperties()) {
+            if (p.getType() == sfbx::PropertyType::Float64Array) {
+                testExpect(((uintptr_t)p.getArray<sfbx::float64>().data() & (alignof(sfbx::float64) - 1)) == 0);
+            }
+            else if (p.getType() == sfbx::PropertyType::Int32Array) {
+                testExpect(((uintptr_t)p.getArray<sfbx::int32>().data() & (alignof(sfbx::int32) - 1)) == 0);
+            }
+        }
+    }
+}
+
+testCase(fbxLazyDecompression)
+{
+    // depends on fbxWrite's output
+    sfbx::LoadOptions opt;
+    opt.lazy_decompression = true;
+    sfbx::DocumentPtr lazy = sfbx::MakeDocument("test_base_bin.fbx", opt);
+    sfbx::DocumentPtr eager = sfbx::MakeDocument("test_base_bin.fbx");
+    testExpect(lazy->valid() && eager->valid());
+
+    auto n1 = lazy->getAllNodes();
+    auto n2 = eager->getAllNodes();
+    testExpect(n1.size() == n2.size());
+    for (size_t ni = 0; ni < n1.size(); ++ni) {
+        auto p1 = n1[ni]->getProperties();
+        auto p2 = n2[ni]->getProperties();
+        testExpect(p1.size() == p2.size());
+        for (size_t pi = 0; pi < p1.size(); ++pi) {
+            if (p1[pi].getType() != sfbx::PropertyType::Float64Array)
+                continue;
+            // size must be available before decompression
+            testExpect(p1[pi].getArraySize() == p2[pi].getArraySize());
+            auto a1 = p1[pi].getArray<sfbx::float64>();
+            auto a2 = p2[pi].getArray<sfbx::float64>();
+            testExpect(std::equal(a1.begin(), a1.end(), a2.begin()));
+        }
+    }
+
+    // arrays still compressed are classified by the size after decompression when written.
+    // with a threshold between the compressed and the uncompressed size, they must be compressed again.
+    {
+        std::vector<sfbx::float64> zeros(4096);
+        sfbx::DocumentPtr src = sfbx::MakeDocument();
+        src->createNode("Zeros")->addProperty(make_span(zeros));
+        testExpect(src->writeBinary("test_lazy_threshold.fbx"));
+
+        sfbx::DocumentPtr lz = sfbx::MakeDocument("test_lazy_threshold.fbx", opt);
+        sfbx::DocumentPtr ez = sfbx::MakeDocument("test_lazy_threshold.fbx");
+        sfbx::Property* prop = lz->findNode("Zeros")->getProperty(0);
+        testExpect(prop->isCompressed() && prop->getArraySize() == zeros.size());
+
+        sfbx::WriteOptions wopt;
+        wopt.compression.threshold = 1024;
+        int level = ez->findNode("Zeros")->getProperty(0)->getCompressionLevel(wopt.compression);
+        testExpect(level != 0);
+        testExpect(prop->getCompressionLevel(wopt.compression) == level);
+        testExpect(prop->isCompressed());
+
+        wopt.parallel = false;
+        std::stringstream s1, s2;
+        ez->writeBinary(s1, wopt);
+        lz->writeBinary(s2, wopt);
+        testExpect(s1.str().size() < zeros.size() * sizeof(sfbx::float64));
+        testExpect(s1.str() == s2.str());
+
+        // same through the parallel pre-compression and the cache of compressed arrays
+        sfbx::DocumentPtr lz2 = sfbx::MakeDocument("test_lazy_threshold.fbx", opt);
+        wopt.parallel = true;
+        wopt.reuse_compressed_arrays = true;
+        for (int i = 0; i < 2; ++i) {
+            std::stringstream s3;
+            lz2->writeBinary(s3, wopt);
+            testExpect(s3.str() == s1.str());
+        }
+    }
+}
+
+testCase(fbxParallelRead)
+{
+    // depends on fbxWrite's output
+    sfbx::LoadOptions opt;
+    opt.parallel = false;
+    sfbx::DocumentPtr serial = sfbx::MakeDocument("test_base_bin.fbx", opt);
+    sfbx::DocumentPtr parallel = sfbx::MakeDocument("test_base_bin.fbx");
+    testExpect(serial->valid() && parallel->valid());
+
+    std::stringstream s1, s2;
+    serial->writeAscii(s1);
+    parallel->writeAscii(s2);
+    testExpect(s1.str() == s2.str());
+}
+
+testCase(fbxParallelReadFailure)
+{
+    // depends on fbxWrite's output
+    // a broken object fails the read. nodes that are left must not refer nodes of the failed parse.
+    auto check_nodes = [](sfbx::Document* doc) {
+        sfbx::Node* objects = doc->findNode("Objects");
+        testExpect(objects);
+        auto all = doc->getAllNodes();
+        for (sfbx::Node* child : objects->getChildren())
+            testExpect(std::any_of(all.begin(), all.end(), [child](auto& n) { return n.get() == child; }));
+    };
+
+    {
+        std::ifstream file("test_base_bin.fbx", std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        // make the encoding of the first "Vertices" array invalid. (type, array size, encoding)
+        size_t pos = data.find("Vertices");
+        testExpect(pos != std::string::npos);
+        pos += std::strlen("Vertices");
+        testExpect(data[pos] == 'd');
+        data[pos + 1 + 4] = 7;
+
+        auto doc = sfbx::MakeDocument(sfbx::span<const char>(data.data(), data.size()));
+        testExpect(!doc->valid());
+        check_nodes(doc.get());
+    }
+    {
+        std::ifstream file("test_base_ascii.fbx", std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        // make the first "Vertices" array longer than its values
+        size_t pos = data.find("Vertices: *");
+        testExpect(pos != std::string::npos);
+        data.insert(pos + std::strlen("Vertices: *"), "1");
+
+        auto doc = sfbx::MakeDocument(sfbx::span<const char>(data.data(), data.size()));
+        testExpect(!doc->valid());
+        check_nodes(doc.get());
+    }
+}
+
+testCase(fbxParallelImport)
+{
+    // depends on fbxWrite's output
+    sfbx::LoadOptions opt;
+    opt.parallel = false;
+    sfbx::DocumentPtr serial = sfbx::MakeDocument("test_base_bin.fbx", opt);
+    sfbx::DocumentPtr parallel = sfbx::MakeDocument("test_base_bin.fbx");
+    testExpect(serial->valid() && parallel->valid());
+
+    auto o1 = serial->getAllObjects();
+    auto o2 = parallel->getAllObjects();
+    testExpect(o1.size() == o2.size());
+    testExpect(serial->getRootObjects().size() == parallel->getRootObjects().size());
+    for (size_t i = 0; i < o1.size(); ++i) {
+        testExpect(o1[i]->getID() == o2[i]->getID());
+        if (auto m1 = as<sfbx::GeomMesh>(o1[i].get())) {
+            auto m2 = as<sfbx::GeomMesh>(o2[i].get());
+            testExpect(m2 && m1->getPoints().size() == m2->getPoints().size());
+            testExpect(std::equal(m1->getPoints().begin(), m1->getPoints().end(), m2->getPoints().begin()));
+            testExpect(std::equal(m1->getCounts().begin(), m1->getCounts().end(), m2->getCounts().begin()));
+        }
+        else if (auto c1 = as<sfbx::Cluster>(o1[i].get())) {
+            auto c2 = as<sfbx::Cluster>(o2[i].get());
+            testExpect(c2 && c1->getWeights().size() == c2->getWeights().size());
+            testExpect(std::equal(c1->getWeights().begin(), c1->getWeights().end(), c2->getWeights().begin()));
+        }
+        else if (auto a1 = as<sfbx::AnimationCurve>(o1[i].get())) {
+            auto a2 = as<sfbx::AnimationCurve>(o2[i].get());
+            testExpect(a2 && a1->getRawValues().size() == a2->getRawValues().size());
+            testExpect(std::equal(a1->getRawValues().begin(), a1->getRawValues().end(), a2->getRawValues().begin()));
+        }
+    }
+}
+
+testCase(fbxSkipNodes)
+{
+    // depends on fbxWrite's output
+    sfbx::LoadOptions opt;
+    opt.skip_nodes = { "Takes" };
+    opt.skip_objects = { sfbx::ObjectClass::Geometry, sfbx::ObjectClass::Deformer };
+
+    for (const char* path : { "test_base_bin.fbx", "test_base_ascii.fbx" }) {
+        sfbx::DocumentPtr doc = sfbx::MakeDocument(path, opt);
+        testExpect(doc->valid());
+        testExpect(doc->findNode("Takes") == nullptr);
+        testExpect(doc->countObjects<sfbx::Model>() > 0);
+        for (auto& obj : doc->getAllObjects()) {
+            testExpect(obj->getClass() != sfbx::ObjectClass::Deformer);
+            // GeomMesh may be created on demand, but must not be loaded
+            if (auto geom = as<sfbx::GeomMesh>(obj.get()))
+                testExpect(geom->getPoints().empty());
+        }
+    }
+}
+
+testCase(fbxVisitNodes)
+{
+    // depends on fbxWrite's output
+    struct Counter : public sfbx::NodeVisitor
+    {
+        std::string skip;
+        size_t num_nodes = 0;
+        size_t num_props = 0;
+        int depth = 0;
+        bool balanced = true;
+
+        bool enterNode(sfbx::string_view name) override
+        {
+            if (name == skip)
+                return false;
+            ++num_nodes;
+            ++depth;
+            return true;
+        }
+        void visitProperty(const sfbx::Property& prop) override
+        {
+            ++num_props;
+            if (prop.isArray())
+                prop.getArray<sfbx::float64>(); // decompress on access
+        }
+        void leaveNode(sfbx::string_view /*name*/) override
+        {
+            if (--depth < 0)
+                balanced = false;
+        }
+    };
+
+    for (const char* path : { "test_base_bin.fbx", "test_base_ascii.fbx" }) {
+        sfbx::DocumentPtr doc = sfbx::MakeDocument(path);
+        size_t num_props = 0;
+        for (auto& n : doc->getAllNodes())
+            num_props += n->getProperties().size();
+
+        Counter all;
+        testExpect(sfbx::VisitNodes(path, all));
+        testExpect(all.balanced && all.depth == 0);
+        testExpect(all.num_nodes == doc->getAllNodes().size());
+        testExpect(all.num_props == num_props);
+
+        Counter partial;
+        partial.skip = "Objects";
+        testExpect(sfbx::VisitNodes(path, partial));
+        testExpect(partial.balanced && partial.depth == 0);
+        testExpect(partial.num_nodes < all.num_nodes);
+
+        // streams give the same results. binary FBX is read from them record by record.
+        std::ifstream file(path, std::ios::binary);
+        Counter streamed;
+        testExpect(sfbx::VisitNodes(file, streamed));
+        testExpect(streamed.balanced && streamed.depth == 0);
+        testExpect(streamed.num_nodes == all.num_nodes && streamed.num_props == all.num_props);
+
+        std::ifstream file2(path, std::ios::binary);
+        Counter streamed_partial;
+        streamed_partial.skip = "Objects";
+        testExpect(sfbx::VisitNodes(file2, streamed_partial));
+        testExpect(streamed_partial.num_nodes == partial.num_nodes && streamed_partial.num_props == partial.num_props);
+    }
+
+    {
+        // 32bit size records of FBX 2014 / 2015
+        sfbx::DocumentPtr doc = sfbx::MakeDocument("test_base_bin.fbx");
+        doc->setFileVersion(sfbx::FileVersion::Fbx2014);
+        std::stringstream ss;
+        doc->writeBinary(ss);
+        sfbx::DocumentPtr r = sfbx::MakeDocument(ss);
+        testExpect(r->valid() && r->getFileVersion() == sfbx::FileVersion::Fbx2014);
+
+        ss.seekg(0);
+        Counter streamed;
+        testExpect(sfbx::VisitNodes(ss, streamed));
+        testExpect(streamed.balanced && streamed.depth == 0);
+        testExpect(streamed.num_nodes == r->getAllNodes().size());
+
+        // truncated data fails
+        std::string data = ss.str();
+        std::istringstream truncated(data.substr(0, data.size() / 2));
+        Counter broken;
+        testExpect(!sfbx::VisitNodes(truncated, broken));
+    }
+
+    {
+        // braces in strings don't count. (the visitor uses the same parser as Document)
+        std::string text =
+            "; FBX 7.4.0 project file\n"
+            "A: \"}\" {\n"
+            "\tB: \"{\" {\n"
+            "\t}\n"
+            "}\n"
+            "C: 1\n";
+        sfbx::DocumentPtr doc = sfbx::MakeDocument(sfbx::span<const char>(text.data(), text.size()));
+        testExpect(doc->getAllNodes().size() == 3);
+
+        std::istringstream is(text);
+        Counter all;
+        testExpect(sfbx::VisitNodes(is, all));
+        testExpect(all.balanced && all.depth == 0);
+        testExpect(all.num_nodes == doc->getAllNodes().size());
+        testExpect(all.num_props == 3);
+    }
+}
+
+testCase(fbxProbeFile)
+{
+    // depends on fbxWrite's output
+    for (const char* path : { "test_base_bin.fbx", "test_base_ascii.fbx" }) {
+        sfbx::DocumentPtr doc = sfbx::MakeDocument(path);
+        sfbx::FileInfo info = sfbx::ProbeFile(path);
+        testExpect(info.version == doc->getFileVersion());
+        testExpect(info.takes.size() == doc->getAnimationStacks().size());
+
+        for (auto& ot : info.object_types) {
+            if (ot.name == "Model") {
+                testExpect(ot.count == (sfbx::int64)doc->countObjects<sfbx::Model>());
+            }
+            else if (ot.name == "Geometry") {
+                testExpect(ot.count == (sfbx::int64)doc->countObjects<sfbx::Geometry>());
+                if (!info.ascii) {
+                    // same as the arrays in the geometry nodes and their descendants
+                    uint64_t expected = 0;
+                    std::function<void(sfbx::Node*)> sum = [&](sfbx::Node* n) {
+                        for (auto& prop : n->getProperties()) {
+                            if (prop.isArray())
+                                expected += prop.getArraySize() * sfbx::SizeOfElement(prop.getType());
+                        }
+                        for (auto* c : n->getChildren())
+                            sum(c);
+                    };
+                    for (auto* n : doc->findNode("Objects")->getChildren()) {
+                        if (n->getName() == "Geometry")
+                            sum(n);
+                    }
+                    testExpect(ot.array_size > 0 && ot.array_size == expected);
+                }
+            }
+        }
+    }
+    testExpect(sfbx::ProbeFile("nonexistent.fbx").version == sfbx::FileVersion::Unknown);
+}
+
+testCase(fbxReadMemory)
+{
+    // depends on fbxWrite's output
+    for (const char* path : { "test_base_bin.fbx", "test_base_ascii.fbx" }) {
+        auto load_file = [path]() {
+            sfbx::RawVector<char> data;
+            std::ifstream fin(path, std::ios::binary);
+            fin.seekg(0, std::ios::end);
+            data.resize((size_t)fin.tellg());
+            fin.seekg(0, std::ios::beg);
+            fin.read(data.data(), data.size());
+            return data;
+        };
+
+        sfbx::DocumentPtr expected = sfbx::MakeDocument(path);
+        std::stringstream s0;
+        expected->writeAscii(s0);
+
+        // copying read. the source buffer is destroyed right after load.
+        sfbx::DocumentPtr doc1 = std::make_shared<sfbx::Document>();
+        {
+            auto data = load_file();
+            testExpect(doc1->read(make_span(data)));
+            memset(data.data(), 0, data.size());
+        }
+        std::stringstream s1;
+        doc1->writeAscii(s1);
+        testExpect(s1.str() == s0.str());
+
+        // ownership-transferring read
+        sfbx::DocumentPtr doc2 = sfbx::MakeDocument(load_file());
+        std::stringstream s2;
+        doc2->writeAscii(s2);
+        testExpect(s2.str() == s0.str());
+    }
+}
+
+testCase(fbxWriteNonSeekable)
+{
+    // streambuf without seek support. (like pipes)
+    struct StringBuf : public std::streambuf
+    {
+        std::string data;
+        int overflow(int c) override { data += (char)c; return c; }
+        std::streamsize xsputn(const char* s, std::streamsize n) override { data.append(s, (size_t)n); return n; }
+    };
+
+    // depends on fbxWrite's output
+    sfbx::DocumentPtr doc = sfbx::MakeDocument("test_base_bin.fbx");
+    testExpect(doc->valid());
+
+    std::stringstream seekable;
+    doc->writeBinary(seekable);
+
+    StringBuf buf;
+    std::ostream non_seekable(&buf);
+    testExpect(non_seekable.tellp() == std::streampos(-1));
+    doc->writeBinary(non_seekable);
+    testExpect(seekable.str() == buf.data);
+
+    // writing to a path doesn't go through std::ostream
+    testExpect(doc->writeBinary("test_write_direct.fbx"));
+    std::ifstream file("test_write_direct.fbx", std::ios::binary);
+    std::string direct((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    testExpect(seekable.str() == direct);
+}
+
+testCase(fbxWriteOptions)
+{
+    // depends on fbxWrite's output
+    sfbx::DocumentPtr doc = sfbx::MakeDocument("test_base_bin.fbx");
+    testExpect(doc->valid());
+
+    auto write = [&](const sfbx::WriteOptions& opt) {
+        std::stringstream ss;
+        doc->writeBinary(ss, opt);
+        return ss.str();
+    };
+
+    sfbx::WriteOptions opt;
+    std::string def = write(opt);
+
+    opt.compression.store_only = true;
+    std::string stored = write(opt);
+    testExpect(stored.size() > def.size());
+
+    opt.compression = {};
+    opt.compression.adaptive = true;
+    opt.compression.overrides = { { sfbx::PropertyType::Float64Array, 1, 0 } };
+    std::string adaptive = write(opt);
+
+    opt.parallel = false;
+    testExpect(write(opt) == adaptive);
+
+    // writes of the same document with different options on multiple threads at once.
+    // each write keeps its own state and must not be affected by the others.
+    {
+        sfbx::WriteOptions stored_opt;
+        stored_opt.compression.store_only = true;
+        sfbx::WriteOptions reuse_opt = opt;
+        reuse_opt.reuse_compressed_arrays = true;
+
+        std::string results[4];
+        std::thread threads[] = {
+            std::thread([&]() { results[0] = write({}); }),
+            std::thread([&]() { results[1] = write(stored_opt); }),
+            std::thread([&]() { results[2] = write(reuse_opt); }),
+            std::thread([&]() { results[3] = write(reuse_opt); }),
+        };
+        for (auto& t : threads)
+            t.join();
+        testExpect(results[0] == def);
+        testExpect(results[1] == stored);
+        testExpect(results[2] == adaptive);
+        testExpect(results[3] == adaptive);
+    }
+
+    for (auto* data : { &stored, &adaptive }) {
+        sfbx::DocumentPtr r = sfbx::MakeDocument(sfbx::span<const char>(data->data(), data->size()));
+        testExpect(r->valid());
+        testExpect(r->getAllNodes().size() == doc->getAllNodes().size());
+
+        std::stringstream s1, s2;
+        doc->writeAscii(s1);
+        r->writeAscii(s2);
+        testExpect(s1.str() == s2.str());
+    }
+}
+
+testCase(fbxExportDeferred)
+{
+    // depends on fbxWrite's output
+    sfbx::DocumentPtr doc = sfbx::MakeDocument("test_base_bin.fbx");
+    testExpect(doc->valid());
+
+    sfbx::ExportOptions opt;
+    opt.refer_object_data = true;
+    doc->exportFBXNodes(opt);
+
+    size_t num_deferred = 0;
+    for (auto& n : doc->getAllNodes()) {
+        for (auto& p : n->getProperties()) {
+            if (p.isDeferred())
+                ++num_deferred;
+        }
+    }
+    testExpect(num_deferred > 0);
+
+    std::stringstream ss;
+    doc->writeBinary(ss);
+    std::string data = ss.str();
+    sfbx::DocumentPtr r = sfbx::MakeDocument(sfbx::span<const char>(data.data(), data.size()));
+    testExpect(r->valid());
+
+    auto o1 = doc->getAllObjects();
+    auto o2 = r->getAllObjects();
+    testExpect(o1.size() == o2.size());
+    for (size_t i = 0; i < o1.size(); ++i) {
+        if (auto m1 = as<sfbx::GeomMesh>(o1[i].get())) {
+            auto m2 = as<sfbx::GeomMesh>(o2[i].get());
+            testExpect(m2 && m1->getPoints().size() == m2->getPoints().size());
+            testExpect(std::equal(m1->getPoints().begin(), m1->getPoints().end(), m2->getPoints().begin()));
+            testExpect(m1->getNormalLayers().size() == m2->getNormalLayers().size());
+            for (size_t li = 0; li < m1->getNormalLayers().size(); ++li) {
+                auto& n1 = m1->getNormalLayers()[li].data;
+                auto& n2 = m2->getNormalLayers()[li].data;
+                testExpect(n1.size() == n2.size() && std::equal(n1.begin(), n1.end(), n2.begin()));
+            }
+        }
+        else if (auto a1 = as<sfbx::AnimationCurve>(o1[i].get())) {
+            auto a2 = as<sfbx::AnimationCurve>(o2[i].get());
+            testExpect(a2 && a1->getRawValues().size() == a2->getRawValues().size());
+            testExpect(std::equal(a1->getRawValues().begin(), a1->getRawValues().end(), a2->getRawValues().begin()));
+        }
+    }
+}
+
+testCase(fbxConvertFloatToDouble)
+{
+    // odd sizes to cover both vectorized and remainder parts
+    for (size_t n : { 0, 1, 3, 4, 7, 16, 33 }) {
+        std::vector<float> src(n);
+        for (size_t i = 0; i < n; ++i)
+            src[i] = (float)i * 0.1f - 1.0f;
+        std::vector<double> dst(n);
+        sfbx::ConvertFloatToDouble(dst.data(), src.data(), n);
+        for (size_t i = 0; i < n; ++i)
+            testExpect(dst[i] == (double)src[i]);
+    }
+}
+
+testCase(fbxReuseCompressed)
+{
+    // depends on fbxWrite's output
+    sfbx::DocumentPtr doc = sfbx::MakeDocument("test_base_bin.fbx");
+    testExpect(doc->valid());
+
+    auto write = [&](const sfbx::WriteOptions& opt) {
+        std::stringstream ss;
+        doc->writeBinary(ss, opt);
+        return ss.str();
+    };
+
+    sfbx::WriteOptions opt;
+    doc->exportFBXNodes();
+    std::string def = write(opt);
+
+    opt.reuse_compressed_arrays = true;
+    testExpect(write(opt) == def);
+    // compressed arrays of the previous write are reused
+    testExpect(write(opt) == def);
+
+    // modify a mesh and re-export. only its arrays have to be compressed again.
+    sfbx::GeomMesh* mesh = nullptr;
+    for (auto& obj : doc->getAllObjects()) {
+        if ((mesh = as<sfbx::GeomMesh>(obj.get())))
+            break;
+    }
+    testExpect(mesh && !mesh->getPoints().empty());
+    mesh->getPoints()[0].x += 1.0f;
+    doc->exportFBXNodes();
+
+    std::string modified = write(opt);
+    testExpect(modified != def);
+    opt.reuse_compressed_arrays = false;
+    testExpect(write(opt) == modified);
+
+    // same with deferred arrays and without worker threads.
+    // compare writes of the same export as re-exporting updates the creation time stamp.
+    sfbx::ExportOptions eopt;
+    eopt.refer_object_data = true;
+    doc->exportFBXNodes(eopt);
+    std::string deferred = write(opt);
+    opt.reuse_compressed_arrays = true;
+    opt.parallel = false;
+    testExpect(write(opt) == deferred);
+    testExpect(write(opt) == deferred);
+
+    // clearing the kept arrays only costs compression in the next write
+    doc->clearCompressedArrays();
+    testExpect(write(opt) == deferred);
+    testExpect(write(opt) == deferred);
+    static_assert(std::is_copy_constructible_v<sfbx::Document> && std::is_move_constructible_v<sfbx::Document>);
+
+    // arrays with the same hash but different contents must not share the compressed data.
+    // Hash64() is MurmurHash64A. its block mixing is invertible, so a colliding array can be made by
+    // changing the first element and choosing the second one to cancel the change.
+    {
+        const uint64_t m = 0xc6a4a7935bd1e995ull;
+        uint64_t minv = m;
+        for (int i = 0; i < 5; ++i)
+            minv *= 2 - m * minv;
+        auto mix = [&](uint64_t k) { k *= m; k ^= k >> 47; return k * m; };
+        auto unmix = [&](uint64_t k) { k *= minv; k ^= k >> 47; return k * minv; };
+
+        const size_t n = 32;
+        std::vector<sfbx::int64> a(n), b;
+        for (size_t i = 0; i < n; ++i)
+            a[i] = (sfbx::int64)(i * 3);
+        b = a;
+        b[0] += 1;
+        uint64_t h0 = n * 8 * m;
+        uint64_t ha = (h0 ^ mix(a[0])) * m;
+        uint64_t hb = (h0 ^ mix(b[0])) * m;
+        b[1] = (sfbx::int64)unmix(ha ^ mix(a[1]) ^ hb);
+
+        sfbx::DocumentPtr cdoc = sfbx::MakeDocument();
+        sfbx::Node* node = cdoc->createNode("Collision");
+        node->addProperty(make_span(a));
+        sfbx::Property* prop = node->getProperty(0);
+        uint64_t hash = prop->getPayloadHash();
+
+        sfbx::WriteOptions copt;
+        copt.reuse_compressed_arrays = true;
+        std::stringstream s1;
+        cdoc->writeBinary(s1, copt);
+
+        auto dst = prop->getArray<sfbx::int64>();
+        sfbx::copy(dst.data(), b.data(), n);
+        testExpect(prop->getPayloadHash() == hash);
+
+        std::stringstream s2, s3;
+        cdoc->writeBinary(s2, copt);
+        copt.reuse_compressed_arrays = false;
+        cdoc->writeBinary(s3, copt);
+        testExpect(s1.str() != s3.str());
+        testExpect(s2.str() == s3.str());
+    }
+}
+
+testCase(fbxAsciiNumbers)
+{
+    sfbx::DocumentPtr doc = sfbx::MakeDocument();
+    sfbx::Mesh* node = doc->getRootModel()->createChild<sfbx::Mesh>("mesh");
+    sfbx::GeomMesh* mesh = node->getGeometry();
+
+    // numbers that need full precision to read back exactly
+    int counts[]{ 3, 3 };
+    int indices[]{ 0, 1, 2, 3, 4, 5 };
+    float3 points[]{
+        { 0.1f, 1.0f / 3.0f, -2.0f / 3.0f },
+        { 1e-7f, -1.17549435e-38f, 3.40282347e+38f },
+        { 123456.789f, -0.0f, 16777216.0f },
+        { 0.3f, 1e10f, -1e-10f },
+        { 2.5f, 100.0f, 1.0f },
+        { 0.0f, -7.0f, 65536.0f },
+    };
+    mesh->setCounts(counts);
+    mesh->setIndices(indices);
+    mesh->setPoints(points);
+    doc->exportFBXNodes();
+
+    std::stringstream ss;
+    testExpect(doc->writeAscii(ss));
+    std::string text = ss.str();
+    sfbx::DocumentPtr r = sfbx::MakeDocument(sfbx::span<const char>(text.data(), text.size()));
+    testExpect(r->valid());
+
+    sfbx::GeomMesh* rmesh = nullptr;
+    for (auto& obj : r->getAllObjects()) {
+        if ((rmesh = as<sfbx::GeomMesh>(obj.get())))
+            break;
+    }
+    testExpect(rmesh);
+    auto p1 = mesh->getPoints();
+    auto p2 = rmesh->getPoints();
+    testExpect(p1.size() == p2.size() && memcmp(p1.data(), p2.data(), p1.size_bytes()) == 0);
+    testExpect(rmesh->getIndices().size() == std::size(indices));
+
+    // writing again gives the same text
+    std::stringstream ss2;
+    r->writeAscii(ss2);
+    testExpect(ss2.str() == text);
+}
+
+testCase(fbxDeterministicExport)
+{
+    auto make_scene = []() {
+        sfbx::DocumentPtr doc = sfbx::MakeDocument();
+        sfbx::Model* root = doc->getRootModel();
+
+        // same names under the same parent to make colliding hashes
+        sfbx::Model* joints[3]{};
+        joints[0] = root->createChild<sfbx::LimbNode>("joint");
+        joints[1] = joints[0]->createChild<sfbx::LimbNode>("joint");
+        joints[2] = joints[0]->createChild<sfbx::LimbNode>("joint");
+
+        sfbx::Mesh* node = root->createChild<sfbx::Mesh>("mesh");
+        sfbx::GeomMesh* mesh = node->getGeometry();
+        int counts[]{ 3 };
+        int indices[]{ 0, 1, 2 };
+        float3 points[]{ { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 } };
+        mesh->setCounts(counts);
+        mesh->setIndices(indices);
+        mesh->setPoints(points);
+
+        sfbx::Skin* skin = mesh->createDeformer<sfbx::Skin>();
+        sfbx::BindPose* bind_pose = doc->createObject<sfbx::BindPose>();
+        for (int i = 0; i < 3; ++i) {
+            sfbx::Cluster* cluster = skin->createCluster(joints[i]);
+            int cindices[1]{ i };
+            float weights[1]{ 1.0f };
+            cluster->setIndices(cindices);
+            cluster->setWeights(weights);
+            cluster->setBindMatrix(joints[i]->getGlobalMatrix());
+            bind_pose->addPoseData(joints[i], joints[i]->getGlobalMatrix());
+        }
+
+        sfbx::AnimationStack* take = doc->createObject<sfbx::AnimationStack>("take");
+        sfbx::AnimationLayer* layer = take->createLayer("layer");
+        sfbx::AnimationCurveNode* cn = layer->createCurveNode(sfbx::AnimationKind::Rotation, joints[1]);
+        cn->addValue(0.0f, float3{ 0.0f, 0.0f, 0.0f });
+        cn->addValue(1.0f, float3{ 30.0f, 0.0f, 0.0f });
+        doc->setCurrentTake(take);
+        return doc;
+    };
+    auto write = [](sfbx::DocumentPtr doc) {
+        sfbx::ExportOptions opt;
+        opt.deterministic = true;
+        doc->exportFBXNodes(opt);
+        std::stringstream ss;
+        doc->writeBinary(ss);
+        return ss.str();
+    };
+
+    // two scenes at different addresses give identical bytes
+    sfbx::DocumentPtr doc1 = make_scene();
+    sfbx::DocumentPtr doc2 = make_scene();
+    std::string data1 = write(doc1);
+    std::string data2 = write(doc2);
+    testExpect(data1 == data2);
+    // exporting again doesn't change anything
+    testExpect(write(doc1) == data1);
+
+    // stable IDs are only in the exported nodes. objects keep their original IDs.
+    for (auto& obj : doc1->getAllObjects()) {
+        if (obj->getID() != 0)
+            testExpect(obj->getID() == (sfbx::int64)obj.get());
+    }
+    // and a non-deterministic export uses them again
+    doc1->exportFBXNodes();
+    {
+        std::unordered_set<sfbx::int64> exported_ids;
+        for (auto* n : doc1->findNode("Objects")->getChildren())
+            exported_ids.insert(n->getProperty(0)->getValue<sfbx::int64>());
+        for (auto& obj : doc1->getAllObjects()) {
+            if (obj->getID() != 0)
+                testExpect(exported_ids.count(obj->getID()) == 1);
+        }
+    }
+
+    sfbx::DocumentPtr r = sfbx::MakeDocument(sfbx::span<const char>(data1.data(), data1.size()));
+    testExpect(r->valid());
+    testExpect(r->getAllObjects().size() == doc1->getAllObjects().size());
+    testExpect(r->countObjects<sfbx::Cluster>() == 3);
+    // pose nodes refer joints by IDs
+    size_t num_poses = 0;
+    for (auto& obj : r->getAllObjects()) {
+        if (auto pose = as<sfbx::BindPose>(obj.get())) {
+            ++num_poses;
+            testExpect(pose->getPoseData().size() == 3);
+            for (auto& d : pose->getPoseData())
+                testExpect(d.object && d.object->getName() == "joint");
+        }
+    }
+    testExpect(num_poses == 1);
+}
+
+testCase(fbxAsciiTokenizer)
+{
+    const char* text =
+        "; FBX 7.4.0 project file\n"
+        "; comment with a brace {\n"
+        "Objects:  {\n"
+        "\tGeometry: 100, \"Geometry::mesh\", \"Mesh\" {\n"
+        "\t\tVertices: *6 {\n"
+        "\t\t\ta: 0,1,2,\n"
+        "\t\t\t3,4,5\n"
+        "\t\t}\n"
+        "\t\tPolygonVertexIndex: *0 {\n"
+        "\t\t\ta: \n"
+        "\t\t}\n"
+        "\t}\n"
+        "\tModel: 200, \"Model::a, {b}\", \"Null\" {\n"
+        "\t\tList: 1,2,\n"
+        "\t\t\t3\n"
+        "\t\tLegacy: 4,5\n"
+        "\t\t,6 ; comment\n"
+        "\t\tShading: T\n"
+        "\t}\n"
+        "}\n";
+
+    for (int skip = 0; skip < 2; ++skip) {
+        sfbx::LoadOptions opt;
+        if (skip)
+            opt.skip_objects = { sfbx::ObjectClass::Geometry };
+        sfbx::DocumentPtr doc = sfbx::MakeDocument(sfbx::span<const char>(text, strlen(text)), opt);
+        testExpect(doc->valid());
+
+        sfbx::Node* objects = doc->findNode("Objects");
+        testExpect(objects && objects->getChildren().size() == (skip ? 1 : 2));
+        if (!skip) {
+            sfbx::Node* geom = objects->findChild("Geometry");
+            testExpect(geom && geom->getProperties().size() == 3);
+            auto points = geom->findChild("Vertices")->getProperty(0)->getArray<sfbx::float64>();
+            testExpect(points.size() == 6 && points[0] == 0.0 && points[5] == 5.0);
+            auto* indices = geom->findChild("PolygonVertexIndex")->getProperty(0);
+            testExpect(indices && indices->isArray() && indices->getArraySize() == 0);
+        }
+
+        sfbx::Node* model = objects->findChild("Model");
+        testExpect(model && model->getProperties().size() == 3);
+        // strings may contain ',' and braces
+        testExpect(model->getProperty(1)->getString().find("a, {b}") == 0);
+        // wrapped lists
+        testExpect(model->findChild("List")->getProperties().size() == 3);
+        testExpect(model->findChild("Legacy")->getProperties().size() == 3);
+        testExpect(model->findChild("Shading") != nullptr);
+    }
+}
+
+testCase(fbxAsciiArrayNumbers)
+{
+    const char* text =
+        "; FBX 7.4.0 project file\n"
+        "Objects:  {\n"
+        "\tGeometry: 100, \"Geometry::mesh\", \"Mesh\" {\n"
+        "\t\tVertices: *10 {\n"
+        "\t\t\ta: 42,-7,+3,-0,1.5e3,.25,-2.5E-3,\n"
+        "\t\t\t123456789012345678901,0.1,9007199254740993\n"
+        "\t\t}\n"
+        "\t}\n"
+        "}\n";
+
+    sfbx::DocumentPtr doc = sfbx::MakeDocument(sfbx::span<const char>(text, strlen(text)));
+    testExpect(doc->valid());
+    sfbx::Node* objects = doc->findNode("Objects");
+    testExpect(objects);
+    auto v = objects->findChild("Geometry")->findChild("Vertices")->getProperty(0)->getArray<sfbx::float64>();
+    testExpect(v.size() == 10);
+    testExpect(v[0] == 42.0 && v[1] == -7.0 && v[2] == 3.0);
+    testExpect(v[3] == 0.0 && std::signbit(v[3]));
+    testExpect(v[4] == 1500.0 && v[5] == 0.25 && v[6] == -2.5e-3);
+    // integers longer than 18 digits go through the general path
+    testExpect(v[7] == 123456789012345678901.0 && v[8] == 0.1);
+    // integers beyond 2^53 are rounded as literals are
+    testExpect(v[9] == 9007199254740993.0);
+
+    // fewer values than the size fails
+    std::string broken = text;
+    broken.replace(broken.find("*10"), 3, "*11");
+    sfbx::DocumentPtr doc2 = sfbx::MakeDocument(sfbx::span<const char>(broken.data(), broken.size()));
+    testExpect(!doc2->valid());
+}
+
+testCase(fbxAsciiArrayTypes)
+{
+    const char* text =
+        "; FBX 7.4.0 project file\n"
+        "Objects:  {\n"
+        "\tGeometry: 100, \"Geometry::mesh\", \"Mesh\" {\n"
+        "\t\tVertices: *3 {\n"
+        "\t\t\ta: 0.5,1,2\n"
+        "\t\t}\n"
+        "\t\tPolygonVertexIndex: *3 {\n"
+        "\t\t\ta: 0,1,-3\n"
+        "\t\t}\n"
+        "\t}\n"
+        "\tAnimationCurve: 200, \"AnimCurve::\", \"\" {\n"
+        "\t\tKeyTime: *2 {\n"
+        "\t\t\ta: 0,46186158000\n"
+        "\t\t}\n"
+        "\t\tKeyValueFloat: *2 {\n"
+        "\t\t\ta: 0.1,-2\n"
+        "\t\t}\n"
+        "\t}\n"
+        "}\n";
+
+    sfbx::DocumentPtr doc = sfbx::MakeDocument(sfbx::span<const char>(text, strlen(text)));
+    testExpect(doc->valid());
+    sfbx::Node* objects = doc->findNode("Objects");
+    testExpect(objects);
+    auto get_prop = [&](const char* obj, const char* name) {
+        return objects->findChild(obj)->findChild(name)->getProperty(0);
+    };
+
+    // arrays of known nodes are in the types binary FBX uses
+    auto* points = get_prop("Geometry", "Vertices");
+    testExpect(points->getType() == sfbx::PropertyType::Float64Array);
+    auto* indices = get_prop("Geometry", "PolygonVertexIndex");
+    testExpect(indices->getType() == sfbx::PropertyType::Int32Array);
+    testExpect(indices->getArray<int>().size() == 3 && indices->getArray<int>()[2] == -3);
+    auto* times = get_prop("AnimationCurve", "KeyTime");
+    testExpect(times->getType() == sfbx::PropertyType::Int64Array);
+    testExpect(times->getArray<sfbx::int64>()[1] == 46186158000LL);
+    auto* values = get_prop("AnimationCurve", "KeyValueFloat");
+    testExpect(values->getType() == sfbx::PropertyType::Float32Array);
+    testExpect(values->getArray<float>()[0] == 0.1f && values->getArray<float>()[1] == -2.0f);
+
+    // integers are range checked. values out of the range of the array type fail.
+    auto read_with = [&](const char* from, const char* to) {
+        std::string modified = text;
+        modified.replace(modified.find(from), strlen(from), to);
+        return sfbx::MakeDocument(sfbx::span<const char>(modified.data(), modified.size()));
+    };
+    {
+        sfbx::DocumentPtr r = read_with("0,1,-3", "-2147483648,2147483647,1.5");
+        testExpect(r->valid());
+        auto v = r->findNode("Objects")->findChild("Geometry")->findChild("PolygonVertexIndex")->getProperty(0)->getArray<int>();
+        testExpect(v[0] == -2147483647 - 1 && v[1] == 2147483647 && v[2] == 1);
+    }
+    testExpect(!read_with("0,1,-3", "0,1,2147483648")->valid());
+    testExpect(!read_with("0,1,-3", "0,1,-2147483649")->valid());
+    testExpect(!read_with("0,1,-3", "0,1,1e10")->valid());
+    {
+        // integers longer than 18 digits are still exact
+        sfbx::DocumentPtr r = read_with("0,46186158000", "-9223372036854775808,9223372036854775807");
+        testExpect(r->valid());
+        auto v = r->findNode("Objects")->findChild("AnimationCurve")->findChild("KeyTime")->getProperty(0)->getArray<sfbx::int64>();
+        testExpect(v[0] == INT64_MIN && v[1] == INT64_MAX);
+    }
+    testExpect(!read_with("0,46186158000", "0,9223372036854775808")->valid());
+    testExpect(!read_with("0,46186158000", "0,1e19")->valid());
+}
+
+testCase(fbxParallelReadAscii)
+{
+    // depends on fbxWrite's output
+    auto check = [](sfbx::LoadOptions opt) {
+        opt.parallel = false;
+        sfbx::DocumentPtr serial = sfbx::MakeDocument("test_base_ascii.fbx", opt);
+        opt.parallel = true;
+        sfbx::DocumentPtr parallel = sfbx::MakeDocument("test_base_ascii.fbx", opt);
+        testExpect(serial->valid() && parallel->valid());
+
+        // nodes must be in the same order as sequential parsing
+        auto n1 = serial->getAllNodes();
+        auto n2 = parallel->getAllNodes();
+        testExpect(n1.size() == n2.size());
+        for (size_t i = 0; i < n1.size() && i < n2.size(); ++i)
+            testExpect(n1[i]->getName() == n2[i]->getName());
+        testExpect(serial->getRootNodes().size() == parallel->getRootNodes().size());
+        testExpect(serial->getAllObjects().size() == parallel->getAllObjects().size());
+
+        std::stringstream s1, s2;
+        serial->writeAscii(s1);
+        parallel->writeAscii(s2);
+        testExpect(s1.str() == s2.str());
+    };
+
+    check({});
+
+    sfbx::LoadOptions opt;
+    opt.skip_nodes = { "Takes" };
+    opt.skip_objects = { sfbx::ObjectClass::Geometry, sfbx::ObjectClass::Deformer };
+    check(opt);
+}
+
+testCase(fbxParserScan)
+{
+    // find_first_of() and find_string() must match naive search at any alignment and length
+    for (size_t offset = 0; offset < 16; ++offset) {
+        for (size_t len = 0; len <= 48; ++len) {
+            for (size_t hit = 0; hit <= len; ++hit) {
+                std::string s(offset + len + 16, 'x');
+                if (hit < len)
+                    s[offset + hit] = ';';
+                s[offset + len] = '{'; // just past the end. must not be found
+                const char* begin = s.data() + offset;
+                const char* end = begin + len;
+                testExpect(sfbx::find_first_of(begin, end, "{}\";") == begin + hit);
+                testExpect(sfbx::find_char(begin, end, ';') == begin + hit);
+
+                sfbx::string_view str(begin, len);
+                for (sfbx::string_view sub : { ";", ";x", "x;", "xx;" })
+                    testExpect(sfbx::find_string(str, sub) == str.find(sub));
+            }
+        }
+    }
+
+    {
+        sfbx::string_view text = "a\r\nb\n\nc";
+        testExpect(sfbx::get_line(text) == "a");
+        testExpect(sfbx::get_line(text) == "b");
+        testExpect(sfbx::get_line(text) == "c");
+        testExpect(text.empty());
+
+        // consecutive blocks. lines before the first '{' are skipped.
+        sfbx::string_view blocks = "x\nA: {\n}\nC: {\n}\n";
+        testExpect(sfbx::read_brace_block(blocks) == "A: {\n}\n");
+        testExpect(sfbx::read_brace_block(blocks) == "C: {\n}\n");
+        testExpect(sfbx::read_brace_block(blocks).empty() && blocks.empty());
+    }
+
+    // read_brace_block() and skip_brace_block() with one tricky input each. braces in strings and comments don't count.
+    {
+        auto read_block = [](const char* text, sfbx::string_view& rest) {
+            rest = text;
+            return sfbx::read_brace_block(rest);
+        };
+        auto skip_block = [](const char* text) {
+            sfbx::string_view rest = text;
+            sfbx::skip_brace_block(rest);
+            return rest;
+        };
+        sfbx::string_view rest;
+        // brace in a quoted string
+        testExpect(read_block("A: {\n\tB: \"}\"\n}\nC", rest) == "A: {\n\tB: \"}\"\n}\n" && rest == "C");
+        testExpect(skip_block("\tB: \"}\"\n}\nC") == "C");
+        // nested block opened and closed on one line
+        testExpect(read_block("A: {\n\tB: { }\n}\nC", rest) == "A: {\n\tB: { }\n}\n" && rest == "C");
+        testExpect(skip_block("\tB: { }\n}\nC") == "C");
+        // brace in a comment, before and inside the block
+        testExpect(read_block("; {\nA: {\n\t; }\n}\nC", rest) == "A: {\n\t; }\n}\n" && rest == "C");
+        testExpect(skip_block("\t; }\n}\nC") == "C");
+        // the whole block on one line
+        testExpect(read_block("x\nA: { B: 1 }\nC", rest) == "A: { B: 1 }\n" && rest == "C");
+
+        // the delimiter at the very end is found
+        sfbx::string_view until = "abc}}";
+        testExpect(sfbx::read_until(until, "}}", true) == "abc}}" && until.empty());
+    }
+
+    // AsciiTokenizer::skipBlock() with '{' already consumed. each case must end right after its closing '}'.
+    auto skip_block = [](const char* block) {
+        sfbx::AsciiTokenizer tk(block);
+        tk.skipBlock();
+        return tk.getRemaining();
+    };
+    // brace in a quoted string
+    testExpect(skip_block("\tA: \"}\"\n}\nB") == "\nB");
+    testExpect(skip_block("\tA: \"{\"\n}\nB") == "\nB");
+    // nested block opened and closed on one line
+    testExpect(skip_block("\tA: { }\n}\nB") == "\nB");
+    testExpect(skip_block("\tA: {}, {\n\t}\n}\nB") == "\nB");
+    // brace in a comment
+    testExpect(skip_block("\t; }\n}\nB") == "\nB");
+    testExpect(skip_block("\t; {\n}\nB") == "\nB");
+    // quote in a comment doesn't start a string
+    testExpect(skip_block("\t; \"\n}\nB") == "\nB");
+    // unterminated block and string end at the end of data
+    testExpect(skip_block("\tA: {\n}").empty());
+    testExpect(skip_block("\tA: \"}").empty());
+
+    // micro benchmarks. an array payload in ascii FBX is the typical data to scan.
+    std::string data;
+    for (int i = 0; data.size() < 16 * 1024 * 1024; ++i) {
+        data += "0.123456789,-98.7654321,";
+        if (i % 16 == 15)
+            data += "\n";
+    }
+    data += "}\n";
+    const char* begin = data.data();
+    const char* end = begin + data.size();
+    const char* expected = end - 2;
+
+    testPrint("    data size: %.2fMB\n", double(data.size()) / (1024.0 * 1024.0));
+    test::TestScope("find braces (naive)", [&]() {
+        const char* p = begin;
+        while (p < end && *p != '{' && *p != '}' && *p != '"' && *p != ';')
+            ++p;
+        testExpect(p == expected);
+    }, 5);
+    test::TestScope("find braces (find_first_of)", [&]() {
+        testExpect(sfbx::find_first_of(begin, end, "{}\";") == expected);
+    }, 5);
+    test::TestScope("find substring (naive)", [&]() {
+        sfbx::string_view str(begin, data.size()), delim = "}\n";
+        size_t i = 0;
+        for (; i + delim.size() <= str.size(); ++i) {
+            if (str.substr(i, delim.size()) == delim)
+                break;
+        }
+        testExpect(begin + i == expected);
+    }, 5);
+    test::TestScope("find substring (find_string)", [&]() {
+        testExpect(begin + sfbx::find_string(sfbx::string_view(begin, data.size()), "}\n") == expected);
+    }, 5);
+    test::TestScope("lines (get_line)", [&]() {
+        sfbx::string_view str(begin, data.size());
+        size_t n = 0;
+        while (!str.empty()) {
+            sfbx::get_line(str);
+            ++n;
+        }
+        testExpect(n > 0);
+    }, 5);
+    test::TestScope("skip block (skip_brace_block)", [&]() {
+        sfbx::string_view str(begin, data.size());
+        sfbx::skip_brace_block(str);
+        testExpect(str.empty());
+    }, 5);
+    test::TestScope("skip block (AsciiTokenizer::skipBlock)", [&]() {
+        sfbx::AsciiTokenizer tk(sfbx::string_view(begin, data.size()));
+        tk.skipBlock();
+        testExpect(tk.tell() == expected + 1);
+    }, 5);
+}
+
 testCase(fbxAnimationCurve)
 {
     sfbx::DocumentPtr doc = sfbx::MakeDocument();
@@ -5,11 +5,15 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_set>
 #include <algorithm>
 #include <functional>
 #include <memory>
 #include <iostream>
+#include <sstream>
+#include <fstream>
 #include <chrono>
+#include <thread>
 
 #ifdef __cpp_lib_span
     #include <span>